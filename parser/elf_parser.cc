@@ -1,29 +1,18 @@
 #include "elf_parser.h"
 
-#include <unistd.h>
-#include <errno.h>
 #include <iostream>
 #include <cstring>
-#include <fcntl.h>
 #include <exception>
 #include <algorithm>
+#include <numeric>
 #include <sstream>
 #include <fstream>
-
-#include <sys/types.h>
-#include <sys/stat.h>
-
-
-#define PREAD(fd, buff, size, offset) ({ \
-	if (pread((fd), (buff), (size), (offset)) < 0) { \
-		std::cerr << "pread: " << strerror(errno) << std::endl; \
-		close((fd)); \
-		std::abort(); \
-	} \
-})
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 
 
-static inline bool elf_check_file(Elf64_Ehdr *hdr) {
+static inline bool elf_check_file(const Elf64_Ehdr *hdr) {
 	return hdr &&
 		hdr->e_ident[EI_MAG0] == ELFMAG0 &&
 		hdr->e_ident[EI_MAG1] == ELFMAG1 &&
@@ -31,160 +20,355 @@ static inline bool elf_check_file(Elf64_Ehdr *hdr) {
 		hdr->e_ident[EI_MAG3] == ELFMAG3;
 }
 
-static inline bool elf_is64(Elf64_Ehdr *hdr) {
+static inline bool elf_is64(const Elf64_Ehdr *hdr) {
 	return hdr->e_ident[4] == ELFCLASS64;
 }
 
-static inline bool elf_is_riscv(Elf64_Ehdr *hdr) {
+static inline bool elf_is_riscv(const Elf64_Ehdr *hdr) {
 	return hdr->e_machine == EM_RISCV;
 }
 
+static void sort_ranges(std::vector<addr_range_t>& ranges);
+static const addr_range_t *find_range(const std::vector<addr_range_t>& ranges, const uint64_t addr);
+
 elf_data_t::elf_data_t(const char *file_name) :
-		fd(-1) {
-	fd = open(file_name, O_RDONLY);
-	if (fd < 0) {
-		std::cerr << "Unable to open " << file_name << "! Error: " << strerror(errno) << std::endl;
-		throw std::invalid_argument("Unable to open ELF file!");
+		file(file_name), indexed(false) {
+	if (file.size() < sizeof(Elf64_Ehdr)) {
+		throw std::invalid_argument("File is not a 64-bit RISC-V ELF file!");
 	}
+	ehdr = (const Elf64_Ehdr *) file.data();
 
-	PREAD(fd, &ehdr, sizeof(ehdr), 0);
-
-	if (!elf_check_file(&ehdr) || !elf_is64(&ehdr) || !elf_is_riscv(&ehdr)) {
-		close(fd);
+	if (!elf_check_file(ehdr) || !elf_is64(ehdr) || !elf_is_riscv(ehdr)) {
 		throw std::invalid_argument("File is not a 64-bit RISC-V ELF file!");
 	}
+	if ((ehdr->e_shnum > 0 && ehdr->e_shentsize != sizeof(Elf64_Shdr)) ||
+			(ehdr->e_phnum > 0 && ehdr->e_phentsize != sizeof(Elf64_Phdr))) {
+		throw std::invalid_argument("Unsupported ELF header entry sizes!");
+	}
+	// the headers are read in place, the mapping itself is page aligned
+	if ((ehdr->e_shnum > 0 && ehdr->e_shoff % alignof(Elf64_Shdr) != 0) ||
+			(ehdr->e_phnum > 0 && ehdr->e_phoff % alignof(Elf64_Phdr) != 0)) {
+		throw std::invalid_argument("Misaligned ELF header tables!");
+	}
 
-	Elf64_Shdr str_shdr;
-	PREAD(fd, &str_shdr, ehdr.e_shentsize, ehdr.e_shoff + ehdr.e_shstrndx * ehdr.e_shentsize);
-
-	char *tbl = (char *) malloc(str_shdr.sh_size);
-	if (tbl == nullptr) {
-		close(fd);
-		std::abort();
+	auto shdrs = (const Elf64_Shdr *) view(ehdr->e_shoff, ehdr->e_shnum * sizeof(Elf64_Shdr));
+	if (ehdr->e_shstrndx >= ehdr->e_shnum) {
+		throw std::invalid_argument("Missing section header string table!");
 	}
-	PREAD(fd, tbl, str_shdr.sh_size, str_shdr.sh_offset);
+	const Elf64_Shdr& str_shdr = shdrs[ehdr->e_shstrndx];
 
-	for (size_t i = 0; i < ehdr.e_shnum; i++) {
-		Elf64_Shdr shdr;
-		PREAD(fd, &shdr, ehdr.e_shentsize, ehdr.e_ehsize + ehdr.e_shoff + i * ehdr.e_shentsize);
-		elf_shdr_t eshdr = { std::string(tbl + shdr.sh_name), shdr };
+	section_hdrs.reserve(ehdr->e_shnum);
+	for (size_t i = 0; i < ehdr->e_shnum; i++) {
+		elf_shdr_t eshdr = { string_at(str_shdr, shdrs[i].sh_name), &shdrs[i] };
 		section_hdrs.push_back(eshdr);
 	}
-	free(tbl);
 
 	for (auto& eshdr : section_hdrs) {
-		if (eshdr.shdr.sh_type == SHT_SYMTAB) {
-			Elf64_Sym *sym_table = (Elf64_Sym *) malloc(eshdr.shdr.sh_size);
-			if (sym_table == nullptr) {
-				close(fd);
-				std::cerr << "Failed to malloc symbol table!" << std::endl;
-				std::abort();
-			}
-			PREAD(fd, sym_table, eshdr.shdr.sh_size, eshdr.shdr.sh_offset);
-
-			elf_shdr_t linked_section = section_hdrs.at(eshdr.shdr.sh_link - 1);
-			char *str_table = (char *) malloc(linked_section.shdr.sh_size);
-			PREAD(fd, str_table, linked_section.shdr.sh_size, linked_section.shdr.sh_offset);
-
-			int entries = eshdr.shdr.sh_size / sizeof(Elf64_Sym);
-			for (int i = 0; i < entries; i++) {
-				std::string name(str_table + sym_table[i].st_name);
-				elf_symbol_t symbol = {name, ELF64_ST_TYPE(sym_table[i].st_info),
-					ELF64_ST_BIND(sym_table[i].st_info), sym_table[i].st_other,
-					sym_table[i].st_shndx, sym_table[i].st_value,
-					sym_table[i].st_size};
-				symbol_table[name] = symbol;
+		if (eshdr.shdr->sh_type == SHT_SYMTAB) {
+			if (eshdr.shdr->sh_offset % alignof(Elf64_Sym) != 0) {
+				throw std::invalid_argument("Misaligned ELF symbol table!");
 			}
-
-			free(str_table);
-			free(sym_table);
+			auto sym_table = (const Elf64_Sym *) view(eshdr.shdr->sh_offset, eshdr.shdr->sh_size);
+			const Elf64_Shdr *str_table = section_hdrs.at(eshdr.shdr->sh_link).shdr;
+			// symbol names are read lazily, so the string table is checked up front
+			view(str_table->sh_offset, str_table->sh_size);
+			symtabs.push_back({ sym_table, eshdr.shdr->sh_size / sizeof(Elf64_Sym), str_table });
+		}
+		// data section, pointers into sections past the end of the file stay unresolved
+		if (eshdr.shdr->sh_type == SHT_PROGBITS && eshdr.shdr->sh_flags == (SHF_WRITE | SHF_ALLOC) &&
+				eshdr.shdr->sh_offset <= file.size() && eshdr.shdr->sh_size <= file.size() - eshdr.shdr->sh_offset) {
+			data_sections.push_back({ eshdr.shdr->sh_addr, eshdr.shdr->sh_size, eshdr.shdr->sh_offset });
+		}
+	}
+	sort_ranges(data_sections);
+
+	phdrs = (const Elf64_Phdr *) view(ehdr->e_phoff, ehdr->e_phnum * sizeof(Elf64_Phdr));
+	for (size_t i = 0; i < ehdr->e_phnum; i++) {
+		// segments whose contents are not in the file cannot be tagged
+		if (phdrs[i].p_type == PT_LOAD &&
+				phdrs[i].p_offset <= file.size() && phdrs[i].p_filesz <= file.size() - phdrs[i].p_offset) {
+			segments.push_back({ phdrs[i].p_vaddr, phdrs[i].p_filesz, phdrs[i].p_offset });
 		}
 	}
+	sort_ranges(segments);
+}
 
-	tbl = (char *) malloc(ehdr.e_phentsize * ehdr.e_phnum);
-	if (!tbl) {
-		close(fd);
-		std::abort();
+// bounds checked pointer into the mapped file
+const char *elf_data_t::view(const uint64_t offset, const uint64_t size) const {
+	if (offset > file.size() || size > file.size() - offset) {
+		throw std::runtime_error("ELF file is truncated!");
 	}
-	PREAD(fd, tbl, ehdr.e_phentsize * ehdr.e_phnum, ehdr.e_phoff);
-	for (int i = 0; i < ehdr.e_phnum; i++) {
-		Elf64_Phdr phdr;
-		memcpy(&phdr, tbl + i * sizeof(Elf64_Phdr), sizeof(Elf64_Phdr));
-		phdrs.push_back(phdr);
+	return file.data() + offset;
+}
+
+std::string_view elf_data_t::string_at(const Elf64_Shdr& str_shdr, const uint32_t offset) const {
+	if (offset >= str_shdr.sh_size) {
+		return std::string_view();
 	}
+	const char *s = view(str_shdr.sh_offset + offset, str_shdr.sh_size - offset);
+	return std::string_view(s, strnlen(s, str_shdr.sh_size - offset));
+}
 
-	struct stat file_status;
-	if (stat(file_name, &file_status) != 0) {
-		std::ostringstream oss;
-		oss << "Failed to read data from '" << file_name << "'!";
-		close(fd);
-		throw std::runtime_error(oss.str());
+void elf_data_t::print_symbols() {
+	for (auto& symtab : symtabs) {
+		for (size_t i = 0; i < symtab.count; i++) {
+			std::cout << string_at(*symtab.str_table, symtab.symbols[i].st_name)
+				<< " value: " << std::hex << symtab.symbols[i].st_value << std::endl;
+		}
 	}
-	data = std::vector<char>(file_status.st_size, 0);
 }
 
-elf_data_t::~elf_data_t() {
-	if (fd > 0) {
-		if (close(fd) < 0) {
-			std::cerr << "Failed to close file descriptor! Error: " << strerror(errno) << std::endl;
+// index every symbol, later symbols with the same name win
+void elf_data_t::index_symbols() {
+	size_t entries = 0;
+	for (auto& symtab : symtabs) {
+		entries += symtab.count;
+	}
+	symbol_table = symbol_index_t();
+	symbol_table.reserve(entries);
+	for (auto& symtab : symtabs) {
+		for (size_t i = 0; i < symtab.count; i++) {
+			symbol_table.insert(string_at(*symtab.str_table, symtab.symbols[i].st_name), &symtab.symbols[i]);
 		}
 	}
+	indexed = true;
 }
 
-void elf_data_t::print_symbols() {
-	for (auto & symbol : symbol_table) {
-		std::cout << symbol.first << " value: " << std::hex << symbol.second.value << std::endl;
+// index only the given names with one pass over the symbol tables
+void elf_data_t::index_symbols(const std::vector<std::string_view>& names) {
+	symbol_table = symbol_index_t();
+	symbol_table.reserve(names.size());
+	for (auto& name : names) {
+		symbol_table.insert(name, nullptr);
+	}
+	for (auto& symtab : symtabs) {
+		for (size_t i = 0; i < symtab.count; i++) {
+			symbol_table.assign(string_at(*symtab.str_table, symtab.symbols[i].st_name), &symtab.symbols[i]);
+		}
 	}
+	indexed = true;
 }
 
 
-elf_symbol_t elf_data_t::get_symbol_info(const std::string& name) const {
-	auto search = symbol_table.find(name);
-	if (search == symbol_table.end()) {
-		throw std::runtime_error("Symbol '" + name + "' doesn't exist in ELF file!");
+elf_symbol_t elf_data_t::get_symbol_info(const std::string_view name) {
+	if (!indexed) {
+		index_symbols();
+	}
+	const Elf64_Sym *sym = symbol_table.find(name);
+	if (sym == nullptr) {
+		throw std::runtime_error("Symbol '" + std::string(name) + "' doesn't exist in ELF file!");
 	}
-	return search->second;
+	return get_symbol_info({ name, sym });
 }
 
+elf_symbol_t elf_data_t::get_symbol_info(const elf_match_t& match) const {
+	const Elf64_Sym *sym = match.sym;
+	return { match.name, ELF64_ST_TYPE(sym->st_info),
+		ELF64_ST_BIND(sym->st_info), sym->st_other,
+		sym->st_shndx, sym->st_value, sym->st_size };
+}
 
-uint64_t elf_data_t::get_ptr_addr(const uint64_t ptr) const {
-	uint64_t r = 0;
 
-	for (auto& eshdr : section_hdrs) {
-		// data section
-		if (eshdr.shdr.sh_type == SHT_PROGBITS && eshdr.shdr.sh_flags == (SHF_WRITE | SHF_ALLOC)) {
-			if (ptr > eshdr.shdr.sh_addr && ptr < eshdr.shdr.sh_addr + eshdr.shdr.sh_size) {
-				PREAD(fd, &r, sizeof(uint64_t), eshdr.shdr.sh_offset + (ptr - eshdr.shdr.sh_addr));
-				break;
+/* Data objects matched by each pattern of the matcher, in symbol table
+ * order. Objects sharing a name are all kept. The symbol tables are
+ * scanned once. */
+std::vector<std::vector<elf_match_t>> elf_data_t::match_symbols(symbol_matcher_t& matcher) const {
+	std::vector<std::vector<elf_match_t>> r(matcher.size());
+	for (auto& symtab : symtabs) {
+		for (size_t i = 0; i < symtab.count; i++) {
+			if (ELF64_ST_TYPE(symtab.symbols[i].st_info) != STT_OBJECT) {
+				continue;
+			}
+			std::string_view name = string_at(*symtab.str_table, symtab.symbols[i].st_name);
+			for (auto pattern : matcher.match(name)) {
+				r[pattern].push_back({ name, &symtab.symbols[i] });
 			}
 		}
 	}
+	return r;
+}
+
+uint64_t elf_data_t::get_ptr_addr(const uint64_t ptr) const {
+	uint64_t r = 0;
+
+	const addr_range_t *section = find_range(data_sections, ptr);
+	if (section != nullptr && ptr > section->addr &&
+			section->offset + (ptr - section->addr) <= file.size() - sizeof(uint64_t)) {
+		memcpy(&r, file.data() + section->offset + (ptr - section->addr), sizeof(uint64_t));
+	}
 
 	return r;
 }
 
 
-void elf_data_t::set_tag_data(const uint64_t addr, const size_t size, const uint8_t tag_index) {
-	Elf64_Phdr phdr;
-	bool found = false;
-	for (auto &p : phdrs) {
-		if (addr >= p.p_vaddr && addr + size <= p.p_vaddr + p.p_filesz) {
-			phdr = p;
-			found = true;
+/* Resolves many pointers at once. The pointers are visited in address
+ * order and read directly from the mapping, the data sections are bounds
+ * checked in the constructor. Pointers that cannot be read are left 0.
+ * Results are in the order of ptrs. */
+std::vector<uint64_t> elf_data_t::get_ptr_addrs(const std::vector<uint64_t>& ptrs) const {
+	std::vector<uint64_t> r(ptrs.size(), 0);
+
+	std::vector<size_t> order(ptrs.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(),
+		[&ptrs](const size_t a, const size_t b) { return ptrs[a] < ptrs[b]; });
+
+	auto section = data_sections.begin();
+	for (auto i : order) {
+		uint64_t ptr = ptrs[i];
+		while (section != data_sections.end() && ptr >= section->addr + section->size) {
+			++section;
+		}
+		if (section == data_sections.end()) {
 			break;
 		}
+		if (ptr <= section->addr) {
+			continue;
+		}
+
+		// the last pointer of a section may reach past its end
+		uint64_t offset = section->offset + (ptr - section->addr);
+		if (offset <= file.size() - sizeof(uint64_t)) {
+			memcpy(&r[i], file.data() + offset, sizeof(uint64_t));
+		}
 	}
-	if (!found) {
+
+	return r;
+}
+
+
+void elf_data_t::set_tag_data(const uint64_t addr, const size_t size, const uint8_t tag_index) {
+	const addr_range_t *segment = find_range(segments, addr);
+	if (segment == nullptr || size > segment->size - (addr - segment->addr)) {
 		throw std::runtime_error("Didn't find data in the ELF file!");
 	}
 
-	uint64_t offset = addr - phdr.p_vaddr;
-	size_t actual_size = (addr + size > phdr.p_vaddr + phdr.p_memsz) ?
-		 phdr.p_vaddr + phdr.p_memsz - addr  :
-		size;
-	memset(data.data() + phdr.p_offset + offset, tag_index, actual_size);
+	tagged.push_back({ segment->offset + (addr - segment->addr), size, tag_index });
+}
+
+static void sort_ranges(std::vector<addr_range_t>& ranges) {
+	std::sort(ranges.begin(), ranges.end(),
+		[](const addr_range_t& a, const addr_range_t& b) { return a.addr < b.addr; });
+}
+
+// binary search for the range containing addr, ranges must not overlap
+static const addr_range_t *find_range(const std::vector<addr_range_t>& ranges, const uint64_t addr) {
+	auto it = std::upper_bound(ranges.begin(), ranges.end(), addr,
+		[](const uint64_t a, const addr_range_t& r) { return a < r.addr; });
+	if (it == ranges.begin()) {
+		return nullptr;
+	}
+	--it;
+	return (addr - it->addr < it->size) ? &*it : nullptr;
 }
 
-void elf_data_t::dump(std::ofstream& out) {
-	out.write(data.data(), data.size());
+/* Writes a file of the same size as the ELF file where every byte holds
+ * the tag of the corresponding ELF byte. Untagged bytes are left as holes,
+ * so only the tagged ranges are stored. */
+void elf_data_t::dump(const std::string& file_path) const {
+	int fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::ostringstream oss;
+		oss << "Unable to open '" << file_path << "'! Error: " << strerror(errno);
+		throw std::runtime_error(oss.str());
+	}
+
+	if (ftruncate(fd, file.size()) < 0) {
+		std::ostringstream oss;
+		oss << "Failed to resize '" << file_path << "'! Error: " << strerror(errno);
+		close(fd);
+		throw std::runtime_error(oss.str());
+	}
+
+	char buff[64 * 1024];
+	for (auto& range : flatten_ranges(tagged)) {
+		if (range.tag == 0 || range.start >= file.size()) {
+			continue;
+		}
+		// the output never grows past the size of the ELF file
+		uint64_t size = std::min<uint64_t>(range.size, file.size() - range.start);
+		memset(buff, range.tag, std::min<uint64_t>(sizeof(buff), size));
+		uint64_t written = 0;
+		while (written < size) {
+			size_t n = std::min<uint64_t>(sizeof(buff), size - written);
+			ssize_t r = pwrite(fd, buff, n, range.start + written);
+			if (r < 0) {
+				std::ostringstream oss;
+				oss << "Failed to write '" << file_path << "'! Error: " << strerror(errno);
+				close(fd);
+				throw std::runtime_error(oss.str());
+			}
+			written += r;
+		}
+	}
+
+	if (close(fd) < 0) {
+		std::cerr << "Failed to close file descriptor! Error: " << strerror(errno) << std::endl;
+	}
+}
+
+
+static inline uint64_t hash_name(const std::string_view name) {
+	uint64_t h = 0xcbf29ce484222325;
+	for (char c : name) {
+		h = (h ^ (uint8_t) c) * 0x100000001b3;
+	}
+	return h;
+}
+
+void symbol_index_t::reserve(size_t n) {
+	size_t capacity = 16;
+	while (capacity < 2 * n) {
+		capacity *= 2;
+	}
+	if (capacity <= slots.size()) {
+		return;
+	}
+
+	std::vector<slot_t> old(capacity, { std::string_view(), nullptr, false });
+	old.swap(slots);
+	for (auto& slot : old) {
+		if (slot.used) {
+			slots[probe(slot.name)] = slot;
+		}
+	}
+}
+
+// linear probing, returns the slot holding name or the empty slot for it
+size_t symbol_index_t::probe(const std::string_view name) const {
+	size_t mask = slots.size() - 1;
+	size_t i = hash_name(name) & mask;
+	while (slots[i].used && slots[i].name != name) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+void symbol_index_t::insert(const std::string_view name, const Elf64_Sym *sym) {
+	reserve(count + 1);
+	slot_t& slot = slots[probe(name)];
+	if (!slot.used) {
+		slot.used = true;
+		slot.name = name;
+		count++;
+	}
+	slot.sym = sym;
+}
+
+bool symbol_index_t::assign(const std::string_view name, const Elf64_Sym *sym) {
+	if (slots.empty()) {
+		return false;
+	}
+	slot_t& slot = slots[probe(name)];
+	if (slot.used) {
+		slot.sym = sym;
+	}
+	return slot.used;
+}
+
+const Elf64_Sym *symbol_index_t::find(const std::string_view name) const {
+	if (slots.empty()) {
+		return nullptr;
+	}
+	return slots[probe(name)].sym;
 }
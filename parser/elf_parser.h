@@ -3,13 +3,17 @@
 
 #include <vector>
 #include <string>
-#include <map>
+#include <string_view>
 
 #include "elf.h"
 
+#include "mapped_file.h"
+#include "tag_range.h"
+#include "symbol_matcher.h"
+
 
 typedef struct {
-	std::string name;
+	std::string_view name;
 	uint8_t type;
 	uint8_t bind;
 	uint8_t visibility;
@@ -19,27 +23,85 @@ typedef struct {
 } elf_symbol_t;
 
 typedef struct {
-	std::string name;
-	Elf64_Shdr shdr;
+	std::string_view name;
+	const Elf64_Shdr *shdr;
 } elf_shdr_t;
 
+/* Symbol table entry matched by a pattern, several entries may share a
+ * name. */
+typedef struct {
+	std::string_view name;
+	const Elf64_Sym *sym;
+} elf_match_t;
+
+
+typedef struct {
+	const Elf64_Sym *symbols;
+	size_t count;
+	const Elf64_Shdr *str_table;
+} elf_symtab_t;
+
+
+/* Maps the virtual addresses [addr, addr + size) to file offsets. */
+typedef struct {
+	uint64_t addr;
+	uint64_t size;
+	uint64_t offset;
+} addr_range_t;
+
+
+/* Open addressing hash table from symbol names to symbol table entries.
+ * Names are views into the ELF file. */
+class symbol_index_t {
+	public:
+		symbol_index_t() : count(0) {}
+		void reserve(size_t n);
+		void insert(const std::string_view name, const Elf64_Sym *sym);
+		bool assign(const std::string_view name, const Elf64_Sym *sym);
+		const Elf64_Sym *find(const std::string_view name) const;
+	private:
+		typedef struct {
+			std::string_view name;
+			const Elf64_Sym *sym;
+			bool used;
+		} slot_t;
+
+		size_t probe(const std::string_view name) const;
 
+		std::vector<slot_t> slots;
+		size_t count;
+};
+
+
+/* ELF file contents are views into the memory mapped file, symbols are
+ * only decoded once they are looked up. */
 class elf_data_t {
 	public:
 		elf_data_t(const char *file_path);
-		~elf_data_t();
 		void print_symbols();
-		elf_symbol_t get_symbol_info(const std::string& name) const;
+		void index_symbols();
+		void index_symbols(const std::vector<std::string_view>& names);
+		elf_symbol_t get_symbol_info(const std::string_view name);
+		elf_symbol_t get_symbol_info(const elf_match_t& match) const;
+		std::vector<std::vector<elf_match_t>> match_symbols(symbol_matcher_t& matcher) const;
 		uint64_t get_ptr_addr(const uint64_t ptr) const;
+		std::vector<uint64_t> get_ptr_addrs(const std::vector<uint64_t>& ptrs) const;
 		void set_tag_data(const uint64_t addr, const size_t size, const uint8_t tag_index);
-		void dump(std::ofstream& out);
+		void dump(const std::string& file_path) const;
 	private:
-		int fd;
+		const char *view(const uint64_t offset, const uint64_t size) const;
+		std::string_view string_at(const Elf64_Shdr& str_shdr, const uint32_t offset) const;
+
+		mapped_file_t file;
+		const Elf64_Ehdr *ehdr;
 		std::vector<elf_shdr_t> section_hdrs;
-		Elf64_Ehdr ehdr;
-		std::map<std::string, elf_symbol_t> symbol_table;
-		std::vector<Elf64_Phdr> phdrs;
-		std::vector<char> data;
+		std::vector<elf_symtab_t> symtabs;
+		symbol_index_t symbol_table;
+		bool indexed;
+		const Elf64_Phdr *phdrs;
+		std::vector<addr_range_t> data_sections;
+		std::vector<addr_range_t> segments;
+		std::vector<tag_range_t> tagged;
 };
 
 
@@ -0,0 +1,436 @@
+#include "symbol_matcher.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cctype>
+
+
+// limits the recursion of nested regex groups
+static const int max_group_depth = 256;
+// the lazily built DFA is thrown away once it grows past this many states
+static const size_t max_dfa_states = 4096;
+// limits of counted repetitions, every repetition copies the repeated piece
+static const int max_repeat_count = 256;
+static const size_t max_nfa_nodes = 1 << 20;
+
+
+static std::bitset<256> escape_class(const char c);
+
+
+symbol_matcher_t::symbol_matcher_t() :
+		patterns(0) {
+	reset_dfa();
+}
+
+size_t symbol_matcher_t::add_glob(const std::string_view pattern) {
+	std::string_view glob = pattern;
+	std::bitset<256> any;
+	any.set();
+
+	int e = node();
+	fragment_t f = { e, e };
+	while (!glob.empty()) {
+		char c = glob.front();
+		glob.remove_prefix(1);
+		switch (c) {
+			case '*':
+				f = concat(f, repeat(literal(any), '*'));
+				break;
+			case '?':
+				f = concat(f, literal(any));
+				break;
+			case '[':
+				f = concat(f, literal(parse_class(glob, true)));
+				break;
+			case '\\':
+				if (glob.empty()) {
+					throw std::runtime_error("Glob ends with an escape!");
+				}
+				c = glob.front();
+				glob.remove_prefix(1);
+				/* fall through */
+			default: {
+				std::bitset<256> chars;
+				chars.set((uint8_t) c);
+				f = concat(f, literal(chars));
+			}
+		}
+	}
+	return add_pattern(f);
+}
+
+size_t symbol_matcher_t::add_regex(const std::string_view pattern) {
+	std::string_view re = pattern;
+	// patterns match whole names, anchors are redundant
+	if (!re.empty() && re.front() == '^') {
+		re.remove_prefix(1);
+	}
+	if (re.size() >= 1 && re.back() == '$' && (re.size() < 2 || re[re.size() - 2] != '\\')) {
+		re.remove_suffix(1);
+	}
+
+	fragment_t f = parse_alternation(re, 0);
+	if (!re.empty()) {
+		throw std::runtime_error("Unmatched ')' in regex!");
+	}
+	return add_pattern(f);
+}
+
+const std::vector<size_t>& symbol_matcher_t::match(const std::string_view name) {
+	if (dfa_states.size() > max_dfa_states) {
+		reset_dfa();
+	}
+
+	int state = dfa_start;
+	for (char c : name) {
+		state = step(state, (uint8_t) c);
+		if (state == 0) {
+			break;
+		}
+	}
+	return dfa_accepts[state];
+}
+
+
+int symbol_matcher_t::node() {
+	nfa.push_back({ std::bitset<256>(), -1, std::vector<int>(), -1 });
+	return nfa.size() - 1;
+}
+
+int symbol_matcher_t::char_node(const std::bitset<256>& chars) {
+	int n = node();
+	nfa[n].chars = chars;
+	return n;
+}
+
+symbol_matcher_t::fragment_t symbol_matcher_t::literal(const std::bitset<256>& chars) {
+	int c = char_node(chars);
+	int e = node();
+	nfa[c].next = e;
+	return { c, e };
+}
+
+symbol_matcher_t::fragment_t symbol_matcher_t::concat(const fragment_t& a, const fragment_t& b) {
+	nfa[a.end].eps.push_back(b.start);
+	return { a.start, b.end };
+}
+
+symbol_matcher_t::fragment_t symbol_matcher_t::alternate(const fragment_t& a, const fragment_t& b) {
+	int s = node();
+	int e = node();
+	nfa[s].eps = { a.start, b.start };
+	nfa[a.end].eps.push_back(e);
+	nfa[b.end].eps.push_back(e);
+	return { s, e };
+}
+
+symbol_matcher_t::fragment_t symbol_matcher_t::repeat(const fragment_t& f, const char op) {
+	int s = node();
+	int e = node();
+	nfa[s].eps.push_back(f.start);
+	if (op != '+') {
+		nfa[s].eps.push_back(e);
+	}
+	if (op != '?') {
+		nfa[f.end].eps.push_back(f.start);
+	}
+	nfa[f.end].eps.push_back(e);
+	return { s, e };
+}
+
+
+symbol_matcher_t::fragment_t symbol_matcher_t::parse_alternation(std::string_view& re, int depth) {
+	fragment_t f = parse_concatenation(re, depth);
+	while (!re.empty() && re.front() == '|') {
+		re.remove_prefix(1);
+		f = alternate(f, parse_concatenation(re, depth));
+	}
+	return f;
+}
+
+symbol_matcher_t::fragment_t symbol_matcher_t::parse_concatenation(std::string_view& re, int depth) {
+	int e = node();
+	fragment_t f = { e, e };
+	while (!re.empty() && re.front() != '|' && re.front() != ')') {
+		f = concat(f, parse_piece(re, depth));
+	}
+	return f;
+}
+
+// an atom followed by any number of repetition operators
+symbol_matcher_t::fragment_t symbol_matcher_t::parse_piece(std::string_view& re, int depth) {
+	const std::string_view begin = re;
+	fragment_t f = parse_atom(re, depth);
+	while (!re.empty()) {
+		if (re.front() == '*' || re.front() == '+' || re.front() == '?') {
+			f = repeat(f, re.front());
+			re.remove_prefix(1);
+		} else if (re.front() == '{') {
+			f = parse_count(re, begin.substr(0, begin.size() - re.size()), f, depth);
+		} else {
+			break;
+		}
+	}
+	if (nfa.size() > max_nfa_nodes) {
+		throw std::runtime_error("Regex is too large!");
+	}
+	return f;
+}
+
+/* Counted repetition of f after the opening '{'. piece is the text f was
+ * parsed from, further copies of f are parsed from it again. */
+symbol_matcher_t::fragment_t symbol_matcher_t::parse_count(
+		std::string_view& re, const std::string_view piece, fragment_t f, int depth) {
+	re.remove_prefix(1);
+	int counts[2] = { -1, -1 };
+	bool comma = false;
+	for (int i = 0; i < 2; i++) {
+		while (!re.empty() && re.front() >= '0' && re.front() <= '9') {
+			counts[i] = std::max(counts[i], 0) * 10 + (re.front() - '0');
+			re.remove_prefix(1);
+			if (counts[i] > max_repeat_count) {
+				throw std::runtime_error("Regex repetition count is too large!");
+			}
+		}
+		if (i == 0 && !re.empty() && re.front() == ',') {
+			comma = true;
+			re.remove_prefix(1);
+		} else {
+			break;
+		}
+	}
+	if (re.empty() || re.front() != '}' || counts[0] < 0) {
+		throw std::runtime_error("Invalid repetition count in regex!");
+	}
+	re.remove_prefix(1);
+
+	int min = counts[0];
+	int max = comma ? counts[1] : min;
+	if (max >= 0 && max < min) {
+		throw std::runtime_error("Invalid repetition count in regex!");
+	}
+
+	// f itself is used as the first copy
+	bool used = false;
+	auto copy = [&]() {
+		if (!used) {
+			used = true;
+			return f;
+		}
+		std::string_view p = piece;
+		return parse_piece(p, depth);
+	};
+
+	int e = node();
+	fragment_t r = { e, e };
+	for (int i = 0; i < min; i++) {
+		r = concat(r, copy());
+	}
+	if (max < 0) {
+		r = concat(r, repeat(copy(), '*'));
+	}
+	for (int i = min; i < max; i++) {
+		r = concat(r, repeat(copy(), '?'));
+	}
+	return r;
+}
+
+symbol_matcher_t::fragment_t symbol_matcher_t::parse_atom(std::string_view& re, int depth) {
+	char c = re.front();
+	re.remove_prefix(1);
+
+	std::bitset<256> chars;
+	switch (c) {
+		case '(': {
+			if (depth >= max_group_depth) {
+				throw std::runtime_error("Regex groups are nested too deeply!");
+			}
+			fragment_t f = parse_alternation(re, depth + 1);
+			if (re.empty() || re.front() != ')') {
+				throw std::runtime_error("Missing ')' in regex!");
+			}
+			re.remove_prefix(1);
+			return f;
+		}
+		case '[':
+			return literal(parse_class(re, false));
+		case '.':
+			chars.set();
+			return literal(chars);
+		case '*':
+		case '+':
+		case '?':
+		case '{':
+			throw std::runtime_error("Nothing to repeat in regex!");
+		case '\\':
+			if (re.empty()) {
+				throw std::runtime_error("Regex ends with an escape!");
+			}
+			c = re.front();
+			re.remove_prefix(1);
+			if (isalnum((uint8_t) c)) {
+				return literal(escape_class(c));
+			}
+			/* fall through */
+		default:
+			chars.set((uint8_t) c);
+			return literal(chars);
+	}
+}
+
+// character class after the opening '['
+std::bitset<256> symbol_matcher_t::parse_class(std::string_view& re, const bool glob) {
+	std::bitset<256> chars;
+	bool negate = !re.empty() && (re.front() == '^' || (glob && re.front() == '!'));
+	if (negate) {
+		re.remove_prefix(1);
+	}
+
+	bool first = true;
+	while (!re.empty() && (re.front() != ']' || first)) {
+		first = false;
+		uint8_t lo = re.front();
+		re.remove_prefix(1);
+		if (lo == '\\' && !re.empty()) {
+			lo = re.front();
+			re.remove_prefix(1);
+			if (!glob && isalnum(lo)) {
+				chars |= escape_class(lo);
+				continue;
+			}
+		}
+		uint8_t hi = lo;
+		if (re.size() >= 2 && re.front() == '-' && re[1] != ']') {
+			hi = re[1];
+			re.remove_prefix(2);
+			if (hi == '\\' && !re.empty()) {
+				hi = re.front();
+				re.remove_prefix(1);
+				if (!glob && isalnum(hi)) {
+					throw std::runtime_error("Character class escape in a range!");
+				}
+			}
+		}
+		for (int c = lo; c <= hi; c++) {
+			chars.set(c);
+		}
+	}
+	if (re.empty()) {
+		throw std::runtime_error("Missing ']' in pattern!");
+	}
+	re.remove_prefix(1);
+
+	return negate ? ~chars : chars;
+}
+
+
+// regex escapes of letters and digits, only the usual classes are supported
+static std::bitset<256> escape_class(const char c) {
+	std::bitset<256> chars;
+	for (int i = 0; i < 256; i++) {
+		switch (tolower(c)) {
+			case 'd':
+				chars[i] = isdigit(i);
+				break;
+			case 'w':
+				chars[i] = isalnum(i) || i == '_';
+				break;
+			case 's':
+				chars[i] = isspace(i);
+				break;
+			default: {
+				std::string msg = "Unsupported escape '\\";
+				throw std::runtime_error(msg + c + "' in regex!");
+			}
+		}
+	}
+	return isupper((uint8_t) c) ? ~chars : chars;
+}
+
+
+size_t symbol_matcher_t::add_pattern(const fragment_t& f) {
+	int accept = node();
+	nfa[accept].pattern = patterns;
+	nfa[f.end].eps.push_back(accept);
+	starts.push_back(f.start);
+	reset_dfa();
+	return patterns++;
+}
+
+// extends states with everything reachable through epsilon edges and keeps
+// only the nodes that consume a character or accept
+void symbol_matcher_t::closure(std::vector<int>& states) const {
+	std::vector<bool> visited(nfa.size());
+	std::vector<int> stack(states);
+	states.clear();
+	while (!stack.empty()) {
+		int n = stack.back();
+		stack.pop_back();
+		if (visited[n]) {
+			continue;
+		}
+		visited[n] = true;
+		if (nfa[n].next >= 0 || nfa[n].pattern >= 0) {
+			states.push_back(n);
+		}
+		for (int e : nfa[n].eps) {
+			stack.push_back(e);
+		}
+	}
+	std::sort(states.begin(), states.end());
+}
+
+int symbol_matcher_t::dfa_state(const std::vector<int>& states) {
+	auto search = dfa_ids.find(states);
+	if (search != dfa_ids.end()) {
+		return search->second;
+	}
+
+	int id = dfa_states.size();
+	std::vector<size_t> accepts;
+	for (int n : states) {
+		if (nfa[n].pattern >= 0) {
+			accepts.push_back(nfa[n].pattern);
+		}
+	}
+	std::sort(accepts.begin(), accepts.end());
+
+	dfa_ids[states] = id;
+	dfa_states.push_back(states);
+	dfa_accepts.push_back(accepts);
+	std::array<int, 256> next;
+	next.fill(-1);
+	dfa_next.push_back(next);
+	return id;
+}
+
+int symbol_matcher_t::step(const int state, const uint8_t c) {
+	if (dfa_next[state][c] >= 0) {
+		return dfa_next[state][c];
+	}
+
+	std::vector<int> next;
+	for (int n : dfa_states[state]) {
+		if (nfa[n].next >= 0 && nfa[n].chars.test(c)) {
+			next.push_back(nfa[n].next);
+		}
+	}
+	closure(next);
+	int id = dfa_state(next);
+	dfa_next[state][c] = id;
+	return id;
+}
+
+// state 0 is the dead state without any NFA nodes
+void symbol_matcher_t::reset_dfa() {
+	dfa_ids.clear();
+	dfa_states.clear();
+	dfa_next.clear();
+	dfa_accepts.clear();
+
+	std::vector<int> dead;
+	dfa_state(dead);
+	std::vector<int> start(starts);
+	closure(start);
+	dfa_start = dfa_state(start);
+}
@@ -0,0 +1,76 @@
+#ifndef _SYMBOL_MATCHER_H_
+#define _SYMBOL_MATCHER_H_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <bitset>
+#include <array>
+#include <map>
+
+
+/* Matches symbol names against many glob and regex patterns at once. All
+ * patterns are compiled into one NFA, which is turned into a DFA lazily
+ * while names are matched, so every name is scanned once no matter how
+ * many patterns there are. Patterns always have to match the whole name.
+ *
+ * Globs support '*', '?', '[...]' and '\' escapes. Regexes support
+ * literals, '.', '[...]', '*', '+', '?', '{n}', '{n,}', '{n,m}', '|',
+ * '(...)', the classes '\d', '\w', '\s' and their negations, and '\'
+ * escapes of other punctuation. Anything else is a syntax error. */
+class symbol_matcher_t {
+	public:
+		symbol_matcher_t();
+		size_t add_glob(const std::string_view pattern);
+		size_t add_regex(const std::string_view pattern);
+		size_t size() const {
+			return patterns;
+		}
+		// ids of the patterns matching name in ascending order
+		const std::vector<size_t>& match(const std::string_view name);
+	private:
+		typedef struct {
+			std::bitset<256> chars;
+			int next;
+			std::vector<int> eps;
+			int pattern;
+		} nfa_node_t;
+
+		typedef struct {
+			int start;
+			int end;
+		} fragment_t;
+
+		int node();
+		int char_node(const std::bitset<256>& chars);
+		fragment_t literal(const std::bitset<256>& chars);
+		fragment_t concat(const fragment_t& a, const fragment_t& b);
+		fragment_t alternate(const fragment_t& a, const fragment_t& b);
+		fragment_t repeat(const fragment_t& f, const char op);
+
+		fragment_t parse_alternation(std::string_view& re, int depth);
+		fragment_t parse_concatenation(std::string_view& re, int depth);
+		fragment_t parse_piece(std::string_view& re, int depth);
+		fragment_t parse_count(std::string_view& re, const std::string_view piece, fragment_t f, int depth);
+		fragment_t parse_atom(std::string_view& re, int depth);
+		std::bitset<256> parse_class(std::string_view& re, const bool glob);
+
+		size_t add_pattern(const fragment_t& f);
+
+		void closure(std::vector<int>& states) const;
+		int dfa_state(const std::vector<int>& states);
+		int step(const int state, const uint8_t c);
+		void reset_dfa();
+
+		std::vector<nfa_node_t> nfa;
+		std::vector<int> starts;
+		size_t patterns;
+
+		std::map<std::vector<int>, int> dfa_ids;
+		std::vector<std::vector<int>> dfa_states;
+		std::vector<std::array<int, 256>> dfa_next;
+		std::vector<std::vector<size_t>> dfa_accepts;
+		int dfa_start;
+};
+
+#endif /* _SYMBOL_MATCHER_H_ */
@@ -9,12 +9,13 @@
 #include <memory>
 #include <sstream>
 #include <list>
+#include <optional>
 
 #include "elf_parser.h"
 #include "tag_parser.h"
+#include "tag_range.h"
 
 #include "policy.h"
-#include "lca.h"
 
 const std::string policy_output_file_name = "policy.mtag";
 const std::string tags_output_file_name = "tags.mtag";
@@ -41,14 +42,7 @@ int main(int argc, char *argv[]) {
 
 	try {
 		policy = std::make_unique<policy_t>(argv[3]);
-		auto& matrix = policy->topology->matrix();
-		auto lca_matrix = compute_lca(matrix);
-		if (lca_matrix.size() > 256) {
-			std::cerr << "The policy is too big: " << lca_matrix.size()
-				<< " tags found, but there are only 256 available!" << std::endl;
-			exit(1);
-		}
-		policy->set_lca_matrix(lca_matrix);
+		policy->compute_lca();
 	} catch (std::runtime_error& err) {
 		std::cerr << err.what() << std::endl;
 		exit(1);
@@ -77,15 +71,34 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	try {
+		tag_data->expand_selectors(*elf_data);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		exit(1);
+	}
+
+	// only the symbols named in the tag file are looked up
+	std::vector<std::string_view> names;
+	names.reserve(tag_data->getentries().size());
+	for (auto& tag_entry : tag_data->getentries()) {
+		if (tag_entry.sym == nullptr) {
+			names.push_back(tag_entry.symbol);
+		}
+	}
+	elf_data->index_symbols(names);
+
 	std::ofstream out_file(policy_output_file_name);
 	if (out_file.is_open()) {
 		policy->dump(out_file);
 		print_tags(out_file, *elf_data, *tag_data, *policy);
 	}
 
-	std::ofstream dup_elf(tags_output_file_name, std::ios::out | std::ios::binary);
-	if (dup_elf.is_open()) {
-		elf_data->dump(dup_elf);
+	try {
+		elf_data->dump(tags_output_file_name);
+	} catch (std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		exit(1);
 	}
 
 
@@ -97,23 +110,65 @@ void print_tags(
 		elf_data_t& elf_data,
 		const tag_data_t& tag_data,
 		const policy_t& policy) {
-	for (auto &tag_entry : tag_data.getentries()) {
+	auto& entries = tag_data.getentries();
+
+	// look up the symbols first, so that all pointers are resolved in one batch
+	std::vector<std::optional<elf_symbol_t>> symbols(entries.size());
+	std::vector<uint64_t> ptrs;
+	for (size_t i = 0; i < entries.size(); i++) {
 		try {
-			elf_symbol_t elf_symbol = elf_data.get_symbol_info(tag_entry.symbol);
-			elf_data.set_tag_data(elf_symbol.value, elf_symbol.size, policy.tag_index(tag_entry.tag));
+			if (entries[i].sym != nullptr) {
+				symbols[i] = elf_data.get_symbol_info({ entries[i].symbol, entries[i].sym });
+			} else {
+				symbols[i] = elf_data.get_symbol_info(entries[i].symbol);
+			}
+			if (entries[i].type == Tag_type::PTR) {
+				ptrs.push_back(symbols[i]->value);
+			}
+		} catch (std::runtime_error&) {
+			// reported when the entry is tagged below
+		}
+	}
+	std::vector<uint64_t> addrs = elf_data.get_ptr_addrs(ptrs);
+
+	// ranges in the order they are tagged, so later entries win overlaps
+	std::vector<tag_range_t> ranges;
+	size_t next_ptr = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		auto& tag_entry = entries[i];
+		try {
+			if (!symbols[i]) {
+				throw std::runtime_error("Symbol not found!");
+			}
+			const elf_symbol_t& elf_symbol = *symbols[i];
+			uint64_t addr = (tag_entry.type == Tag_type::PTR) ? addrs[next_ptr++] : 0;
+			elf_data.set_tag_data(elf_symbol.value, elf_symbol.size, tag_entry.tag);
 			if (tag_entry.type == Tag_type::PTR) {
-				uint64_t addr = elf_data.get_ptr_addr(elf_symbol.value);
 				if (addr > 0) {
-					elf_data.set_tag_data(addr, tag_entry.ptr_size, policy.tag_index(tag_entry.tag));
-					out_print_line(out, addr, tag_entry.ptr_size, policy.tag_index(tag_entry.tag));
+					elf_data.set_tag_data(addr, tag_entry.ptr_size, tag_entry.tag);
+					ranges.push_back({ addr, tag_entry.ptr_size, tag_entry.tag });
 				}
 			}
-			out_print_line(out, elf_symbol.value, elf_symbol.size, policy.tag_index(tag_entry.tag));
+			ranges.push_back({ elf_symbol.value, elf_symbol.size, tag_entry.tag });
 		} catch (std::runtime_error& e) {
 			std::cerr << "Couldn't locate symbol '" <<  tag_entry.symbol
 				<< "' in the ELF file!" << std::endl;
 		}
 	}
+
+	std::vector<tag_conflict_t> conflicts;
+	for (auto& range : flatten_ranges(ranges, &conflicts)) {
+		out_print_line(out, range.start, range.size, range.tag);
+	}
+	for (auto& conflict : conflicts) {
+		std::cerr << "Conflicting tags at 0x" << std::hex << conflict.start << std::dec
+			<< " (" << conflict.size << " bytes): '" << policy.topology->get_tag(conflict.tag)
+			<< "' overrides";
+		for (auto tag : conflict.overridden) {
+			std::cerr << " '" << policy.topology->get_tag(tag) << "'";
+		}
+		std::cerr << std::endl;
+	}
 }
 
 static inline void out_print_line(std::ofstream& out, const uint64_t addr,
@@ -1,67 +1,226 @@
 #include "tag_parser.h"
+#include "symbol_matcher.h"
 
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <thread>
+#include <iterator>
+#include <unordered_map>
 
 
-static Tag_type get_type(std::istringstream& iss);
-static std::pair<std::string, bool> get_symbol(std::istringstream& iss);
-static std::string get_tag(std::istringstream& iss, bool colon);
-static size_t get_ptr_size(std::istringstream& iss, bool& colon);
+/* Result of parsing a chunk of whole lines. On a syntax error the chunk
+ * stops, error_line is the line within the chunk (1-based). */
+typedef struct {
+	std::vector<tag_struct_t> entries;
+	std::string warnings;
+	int lines;
+	int error_line;
+	std::string error;
+} tag_chunk_t;
 
-tag_data_t::tag_data_t(const char *file_path, const policy_t& policy) {
-	std::ifstream infile(file_path);
+/* Policy index of a tag as written in the tag file, -1 if the policy
+ * doesn't have it. */
+typedef struct {
+	int index;
+	std::string name;
+} tag_lookup_t;
 
-	if (!infile.is_open()) {
-		std::ostringstream oss;
-		oss << "Couldn't open tag file: '" << file_path << "'!";
-		throw std::invalid_argument(oss.str());
+// chunks smaller than this are not worth a thread
+static const size_t min_chunk_size = 1 << 20;
+
+
+static void parse_chunk(const char *p, const char *end, const policy_t& policy, tag_chunk_t& chunk);
+static Tag_type get_type(std::string_view& line);
+static std::pair<std::string_view, bool> get_symbol(std::string_view& line);
+static Selector get_selector(std::string_view& symbol);
+static std::string_view get_tag(std::string_view& line, bool colon);
+static size_t get_ptr_size(std::string_view& line, bool& colon);
+
+static inline void skip_space(std::string_view& line);
+static inline std::string_view get_word(std::string_view& line);
+
+static mapped_file_t open_tag_file(const char *file_path);
+
+
+tag_data_t::tag_data_t(const char *file_path, const policy_t& policy) :
+		file(open_tag_file(file_path)), selectors(false) {
+	const char *begin = file.data();
+	const char *end = begin + file.size();
+
+	size_t n = std::min<size_t>(std::thread::hardware_concurrency(), file.size() / min_chunk_size);
+	n = std::max<size_t>(n, 1);
+
+	// split at line boundaries
+	std::vector<const char *> bounds = { begin };
+	for (size_t i = 1; i < n; i++) {
+		const char *p = std::max(begin + file.size() * i / n, bounds.back());
+		const char *nl = (const char *) memchr(p, '\n', end - p);
+		bounds.push_back(nl ? nl + 1 : end);
+	}
+	bounds.push_back(end);
+
+	std::vector<tag_chunk_t> chunks(n);
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < n; i++) {
+		workers.emplace_back(parse_chunk, bounds[i], bounds[i + 1], std::cref(policy), std::ref(chunks[i]));
+	}
+	parse_chunk(bounds[0], bounds[1], policy, chunks[0]);
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	// merge in file order, the first error wins
+	size_t total = 0;
+	for (auto& chunk : chunks) {
+		total += chunk.entries.size();
+	}
+	entries.reserve(total);
+	int line_offset = 0;
+	for (auto& chunk : chunks) {
+		std::cerr << chunk.warnings;
+		if (chunk.error_line > 0) {
+			std::ostringstream oss;
+			oss << "Line " << line_offset + chunk.error_line << ": Wrong syntax! " << chunk.error;
+			throw std::invalid_argument(oss.str());
+		}
+		std::move(chunk.entries.begin(), chunk.entries.end(), std::back_inserter(entries));
+		line_offset += chunk.lines;
 	}
 
-	std::string line;
-	int line_num = 1;
-	while (std::getline(infile, line)) {
+	selectors = std::any_of(entries.begin(), entries.end(),
+		[](const tag_struct_t& e) { return e.selector != Selector::NAME; });
+}
+
+/* Replaces every glob and regex entry with one entry per matching data
+ * object of the ELF file, in place of the pattern and in symbol table
+ * order. All patterns are matched in a single pass over the symbols. */
+void tag_data_t::expand_selectors(const elf_data_t& elf_data) {
+	if (!selectors) {
+		return;
+	}
+
+	symbol_matcher_t matcher;
+	for (auto& entry : entries) {
+		if (entry.selector == Selector::GLOB) {
+			matcher.add_glob(entry.symbol);
+		} else if (entry.selector == Selector::REGEX) {
+			matcher.add_regex(entry.symbol);
+		}
+	}
+	auto matches = elf_data.match_symbols(matcher);
+
+	std::vector<tag_struct_t> expanded;
+	size_t pattern = 0;
+	for (auto& entry : entries) {
+		if (entry.selector == Selector::NAME) {
+			expanded.push_back(entry);
+			continue;
+		}
+		if (matches[pattern].empty()) {
+			std::cerr << "Pattern '" << entry.symbol << "' doesn't match any symbol in the ELF file!"
+				<< std::endl;
+		}
+		for (auto& match : matches[pattern]) {
+			expanded.push_back({ entry.type, Selector::NAME, match.name, entry.tag, entry.ptr_size, match.sym });
+		}
+		pattern++;
+	}
+	entries.swap(expanded);
+	selectors = false;
+}
+
+static void parse_chunk(const char *p, const char *end, const policy_t& policy, tag_chunk_t& chunk) {
+	std::ostringstream warnings;
+	std::unordered_map<std::string_view, tag_lookup_t> tag_indexes;
+	chunk.lines = 0;
+	chunk.error_line = 0;
+	while (p < end) {
+		const char *nl = (const char *) memchr(p, '\n', end - p);
+		std::string_view line(p, (nl ? nl : end) - p);
+		p = nl ? nl + 1 : end;
+		chunk.lines++;
+
+		if (!line.empty() && line.back() == '\r') {
+			line.remove_suffix(1);
+		}
 		if (line.size() == 0) { // skip empty lines
 			continue;
 		}
-		std::istringstream iss(line);
 		try {
 
-			Tag_type type = get_type(iss);
-			auto t = get_symbol(iss);
-			std::string symbol = t.first;
+			Tag_type type = get_type(line);
+			auto t = get_symbol(line);
+			std::string_view symbol = t.first;
+			Selector selector = get_selector(symbol);
 			size_t size = (type == Tag_type::PTR) ?
-				get_ptr_size(iss, t.second) :
+				get_ptr_size(line, t.second) :
 				0;
-			std::string tag = get_tag(iss, t.second);
+			std::string_view tag = get_tag(line, t.second);
+
+			// tag files reuse a handful of tags, look each one up only once
+			auto search = tag_indexes.find(tag);
+			if (search == tag_indexes.end()) {
+				tag_lookup_t lookup = { -1, std::string(tag) };
+				lookup.name.erase(std::remove_if(lookup.name.begin(), lookup.name.end(), isspace), lookup.name.end());
+				try {
+					lookup.index = policy.tag_index(lookup.name);
+				} catch (std::out_of_range&) {
+					// not in the policy, reported for every entry below
+				}
+				search = tag_indexes.emplace(tag, lookup).first;
+			}
 
-			if (policy.contains_tag(tag)) {
-				tag_struct_t tag_data = { type, symbol, tag, size };
-				entries.push_back(tag_data);
+			if (search->second.index >= 0) {
+				tag_struct_t tag_data = { type, selector, symbol, (uint8_t) search->second.index, size, nullptr };
+				chunk.entries.push_back(tag_data);
 			} else {
-				std::cerr << "Tag '" << tag << "' is not in the specified policy!"
+				warnings << "Tag '" << search->second.name << "' is not in the specified policy!"
 					<< std::endl;
 			}
 		} catch (std::runtime_error& err) {
-			std::ostringstream oss;
-			oss << "Line " << line_num << ": Wrong syntax! " << err.what();
-			throw std::invalid_argument(oss.str());
+			chunk.error_line = chunk.lines;
+			chunk.error = err.what();
+			break;
 		}
-		line_num++;
 	}
+	chunk.warnings = warnings.str();
 }
 
-static Tag_type get_type(std::istringstream& iss) {
-	std::string r;
-	char c;
-	while (iss.get(c)) {
-		if (c == ' ') {
-			break;
-		}
-		r += c;
+static mapped_file_t open_tag_file(const char *file_path) {
+	try {
+		return mapped_file_t(file_path);
+	} catch (std::exception& e) {
+		std::ostringstream oss;
+		oss << "Couldn't open tag file: '" << file_path << "'!";
+		throw std::invalid_argument(oss.str());
+	}
+}
+
+static inline void skip_space(std::string_view& line) {
+	size_t i = 0;
+	while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+		i++;
 	}
+	line.remove_prefix(i);
+}
+
+// word up to the next space or colon
+static inline std::string_view get_word(std::string_view& line) {
+	skip_space(line);
+	size_t i = 0;
+	while (i < line.size() && line[i] != ' ' && line[i] != '\t' && line[i] != ':') {
+		i++;
+	}
+	std::string_view r = line.substr(0, i);
+	line.remove_prefix(i);
+	return r;
+}
+
+static Tag_type get_type(std::string_view& line) {
+	std::string_view r = get_word(line);
 	if (r == "ptr") {
 		return Tag_type::PTR;
 	} else if (r == "atom") {
@@ -70,100 +229,85 @@ static Tag_type get_type(std::istringstream& iss) {
 	throw std::runtime_error("Only 'ptr' or 'atom' keywords allowed!");
 }
 
-static std::pair<std::string, bool> get_symbol(std::istringstream& iss) {
-	std::string r;
-	char c;
-	bool colon = false;
-	while (iss.get(c)) {
-		if (c == ':') {
-			colon = true;
-			break;
-		} else if (c == ' ') {
-			break;
-		}
-		r += c;
-	}
-
-	if (iss.eof()) {
+static std::pair<std::string_view, bool> get_symbol(std::string_view& line) {
+	std::string_view r = get_word(line);
+	if (line.empty()) {
 		throw std::runtime_error("Missing rest of tag declaration!");
 	}
+
+	bool colon = line.front() == ':';
+	line.remove_prefix(1);
 	return std::make_pair(r, colon);
 }
 
-static std::string get_tag(std::istringstream& iss, bool colon) {
-	std::string r;
-	char c;
-	if (!colon) {
-		bool colon_found = false;
-		do {
-			iss.get(c);
-			colon_found = c == ':';
-		} while (!colon_found && !iss.eof());
+// strips the slashes of a regex and checks that it compiles
+static Selector get_selector(std::string_view& symbol) {
+	if (symbol.size() >= 2 && symbol.front() == '/' && symbol.back() == '/') {
+		symbol = symbol.substr(1, symbol.size() - 2);
+		symbol_matcher_t().add_regex(symbol);
+		return Selector::REGEX;
+	}
+	if (symbol.find_first_of("*?[") != std::string_view::npos) {
+		symbol_matcher_t().add_glob(symbol);
+		return Selector::GLOB;
+	}
+	return Selector::NAME;
+}
 
-		if (!colon_found) {
+// tag between the quotes, may still contain white space
+static std::string_view get_tag(std::string_view& line, bool colon) {
+	if (!colon) {
+		size_t i = line.find(':');
+		if (i == std::string_view::npos) {
 			throw std::runtime_error("Colon not found in declaration!");
 		}
+		line.remove_prefix(i + 1);
 	}
 
-	do {
-		iss.get(c);
-	} while (c != '"' && !iss.eof());
-	while(iss.get(c) && c != '"') {
-		r += c;
-	}
-	if (c != '"') {
+	size_t start = line.find('"');
+	size_t end = (start == std::string_view::npos) ?
+		std::string_view::npos :
+		line.find('"', start + 1);
+	if (end == std::string_view::npos) {
 		throw std::runtime_error("Missing end of tag declaration '\"'!");
 	}
-	r.erase(std::remove_if(r.begin(), r.end(), isspace), r.end());
-	if (r.size() == 0) {
+
+	std::string_view r = line.substr(start + 1, end - start - 1);
+	line.remove_prefix(end + 1);
+	if (std::all_of(r.begin(), r.end(), isspace)) {
 		throw std::runtime_error("Missing tag in declaration!");
 	}
 	return r;
 }
 
 
-static size_t get_ptr_size(std::istringstream& iss, bool& colon) {
+static size_t get_ptr_size(std::string_view& line, bool& colon) {
 	if (colon) {
 		throw std::runtime_error("Pointer declaration needs size argument!");
 	}
-	char c;
-	size_t r = 0;
-	std::string size_word;
-	for (int i = 0; i < 4; i++) {
-		iss.get(c);
-		size_word += c;
-	}
-	if (size_word != "size") {
+	skip_space(line);
+	if (line.substr(0, 4) != "size") {
 		throw std::runtime_error("Expected 'size' keyword!");
 	}
+	line.remove_prefix(4);
 
-	bool found = false;
-	do {
-		iss.get(c);
-		found = c == '=';
-	} while (!found && !iss.eof());
-
-	if (!found) {
+	skip_space(line);
+	if (line.empty() || line.front() != '=') {
 		throw std::runtime_error("Missing '=' sign in declaration!");
 	}
+	line.remove_prefix(1);
 
-	size_word.clear();
-	do {
-		iss.get(c);
-	} while (c == ' ');
+	std::string_view size_word = get_word(line);
+	size_t r = 0;
+	auto [ptr, ec] = std::from_chars(size_word.data(), size_word.data() + size_word.size(), r);
+	if (ec != std::errc() || ptr != size_word.data() + size_word.size()) {
+		throw std::runtime_error("Invalid pointer size '" + std::string(size_word) + "'!");
+	}
 
-	size_word += c;
-	while (iss.get(c)) {
-		if (c == ' ') {
-			break;
-		}
-		if (c == ':') {
-			colon = true;
-			break;
-		}
-		size_word += c;
+	if (!line.empty() && line.front() == ':') {
+		colon = true;
+		line.remove_prefix(1);
 	}
-	r = std::stoul(size_word);
 
 	return r;
 }
@@ -2,31 +2,49 @@
 #define _TAG_PARSER_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "policy.h"
+#include "mapped_file.h"
+#include "elf_parser.h"
 
 enum class Tag_type {
 	ATOM,
 	PTR
 };
 
+/* How the symbol of an entry is written: a plain name, a glob or a
+ * regex between slashes. For patterns symbol holds the pattern. */
+enum class Selector {
+	NAME,
+	GLOB,
+	REGEX
+};
+
 
 typedef struct {
 	Tag_type type;
-	std::string symbol;
-	std::string tag;
+	Selector selector;
+	std::string_view symbol;
+	uint8_t tag;
 	size_t ptr_size;
+	// symbol matched by a pattern, nullptr if the entry is looked up by name
+	const Elf64_Sym *sym;
 } tag_struct_t;
 
 
+/* Symbol names of the entries are views into the mapped tag file. */
 class tag_data_t {
 	public:
 		tag_data_t(const char *file_name, const policy_t& policy);
 		~tag_data_t() {}
 		const std::vector<tag_struct_t>& getentries() const { return entries; }
+		void expand_selectors(const elf_data_t& elf_data);
 	private:
+		mapped_file_t file;
 		std::vector<tag_struct_t> entries;
+		bool selectors;
 };
 
 #endif
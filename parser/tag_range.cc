@@ -0,0 +1,76 @@
+#include "tag_range.h"
+
+#include <algorithm>
+#include <set>
+#include <array>
+
+
+typedef struct {
+	uint64_t addr;
+	bool open;
+	size_t range;
+} range_event_t;
+
+
+std::vector<tag_range_t> flatten_ranges(const std::vector<tag_range_t>& ranges,
+		std::vector<tag_conflict_t> *conflicts) {
+	std::vector<range_event_t> events;
+	events.reserve(2 * ranges.size());
+	for (size_t i = 0; i < ranges.size(); i++) {
+		if (ranges[i].size == 0) {
+			continue;
+		}
+		events.push_back({ ranges[i].start, true, i });
+		events.push_back({ ranges[i].start + ranges[i].size, false, i });
+	}
+	std::sort(events.begin(), events.end(),
+		[](const range_event_t& a, const range_event_t& b) { return a.addr < b.addr; });
+
+	// the range with the highest index among the open ones is the last write
+	std::set<size_t> open;
+	std::array<size_t, 256> open_tags = {};
+	size_t distinct_tags = 0;
+	std::vector<tag_range_t> r;
+	size_t i = 0;
+	while (i < events.size()) {
+		uint64_t addr = events[i].addr;
+		for (; i < events.size() && events[i].addr == addr; i++) {
+			uint8_t tag = ranges[events[i].range].tag;
+			if (events[i].open) {
+				open.insert(events[i].range);
+				distinct_tags += (open_tags[tag]++ == 0);
+			} else {
+				open.erase(events[i].range);
+				distinct_tags -= (--open_tags[tag] == 0);
+			}
+		}
+		if (open.empty() || i == events.size()) {
+			continue;
+		}
+
+		uint64_t end = events[i].addr;
+		uint8_t tag = ranges[*open.rbegin()].tag;
+		if (!r.empty() && r.back().tag == tag && r.back().start + r.back().size == addr) {
+			r.back().size += end - addr;
+		} else {
+			r.push_back({ addr, end - addr, tag });
+		}
+
+		if (conflicts != nullptr && distinct_tags > 1) {
+			std::vector<uint8_t> overridden;
+			for (size_t t = 0; t < open_tags.size(); t++) {
+				if (open_tags[t] > 0 && t != tag) {
+					overridden.push_back(t);
+				}
+			}
+			if (!conflicts->empty() && conflicts->back().start + conflicts->back().size == addr &&
+					conflicts->back().tag == tag && conflicts->back().overridden == overridden) {
+				conflicts->back().size += end - addr;
+			} else {
+				conflicts->push_back({ addr, end - addr, tag, overridden });
+			}
+		}
+	}
+
+	return r;
+}
@@ -0,0 +1,32 @@
+#ifndef _TAG_RANGE_H_
+#define _TAG_RANGE_H_
+
+#include <vector>
+#include <cstdint>
+
+
+typedef struct {
+	uint64_t start;
+	uint64_t size;
+	uint8_t tag;
+} tag_range_t;
+
+/* Part of the address space where ranges with different tags overlap.
+ * tag is the tag that wins, overridden are the other tags. */
+typedef struct {
+	uint64_t start;
+	uint64_t size;
+	uint8_t tag;
+	std::vector<uint8_t> overridden;
+} tag_conflict_t;
+
+
+/* Resolves overlaps the same way as writing the ranges one after another
+ * would: a later range overwrites the earlier ones. The result is sorted
+ * by address, disjoint, and neighbouring ranges with the same tag are
+ * merged. Empty ranges are dropped. When conflicts is given, it receives
+ * the overlaps between different tags, sorted by address. */
+std::vector<tag_range_t> flatten_ranges(const std::vector<tag_range_t>& ranges,
+	std::vector<tag_conflict_t> *conflicts = nullptr);
+
+#endif /* _TAG_RANGE_H_ */
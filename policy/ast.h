@@ -3,220 +3,189 @@
 
 #include <vector>
 #include <string>
-#include <iostream>
+#include <string_view>
 #include <memory>
+#include <new>
+#include <utility>
+#include <type_traits>
 
-#include "synan.h"
 
+/* Bump allocator for AST nodes. Nodes are carved out of large blocks and
+ * the whole tree is released at once when the arena is destroyed, the
+ * destructors of nodes that own memory run first. */
+class ast_arena_t {
+	public:
+		ast_arena_t() : used(block_size) {}
+		~ast_arena_t();
+		ast_arena_t(const ast_arena_t&) = delete;
+		ast_arena_t& operator=(const ast_arena_t&) = delete;
+
+		template<typename T, typename... Args>
+		T *make(Args&&... args) {
+			T *node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+			if (!std::is_trivially_destructible<T>::value) {
+				destructors.push_back({ node, [](void *p) { static_cast<T *>(p)->~T(); } });
+			}
+			return node;
+		}
+	private:
+		typedef struct {
+			void *object;
+			void (*destroy)(void *);
+		} destructor_t;
+
+		void *allocate(const size_t size, const size_t align);
+
+		static constexpr size_t block_size = 64 * 1024;
+		std::vector<std::unique_ptr<char[]>> blocks;
+		size_t used;
+		std::vector<destructor_t> destructors;
+};
+
+
+enum class Node_kind {
+	SOURCE,
+	PG,
+	TOPOLOGY_BASIC,
+	TOPOLOGY_LINEAR,
+	TOPOLOGY_EXPR,
+	TAG,
+	EXPR_BIN
+};
 
 /* Interfaces */
 
-/* Basic AST node */
+/* Basic AST node, the kind tells which derived class the node is. Names
+ * are views into the policy source, which has to outlive the AST. */
 class ast_node_t {
 	public:
-		virtual ~ast_node_t() = 0;
-		virtual void print() = 0;
+		Node_kind get_kind() const {
+			return kind;
+		}
+	protected:
+		ast_node_t(const Node_kind k) : kind(k) {}
+	private:
+		Node_kind kind;
 };
 
 /* Represents an expression - used for tags and expression topologies */
 class ast_expr_t : public ast_node_t {
-	public:
-		virtual ~ast_expr_t() = 0;
-		virtual void print() {}
+	protected:
+		ast_expr_t(const Node_kind k) : ast_node_t(k) {}
 };
 
 /* Represents a declaration */
 class ast_decl_t : public ast_node_t {
-	public:
-		virtual ~ast_decl_t() = 0;
-		virtual void print() {}
+	protected:
+		ast_decl_t(const Node_kind k) : ast_node_t(k) {}
 };
 
 /* Topology base class */
 class ast_topology_t : public ast_decl_t {
 	public:
-		virtual ~ast_topology_t() {}
-		void set_name(const std::string& n) {
+		void set_name(const std::string_view n) {
 			name = n;
 		}
-		std::string& get_name() {
+		std::string_view get_name() const {
 			return name;
 		}
-		virtual void print() {}
 	protected:
-		std::string name;
+		ast_topology_t(const Node_kind k) : ast_decl_t(k) {}
+		std::string_view name;
 };
 
 /* Derived classes */
 
 class ast_pg_t : public ast_decl_t {
 	public:
-		ast_pg_t(const std::string& file, const std::string& tag) :
-			tag(tag), file(file) {}
-		~ast_pg_t() {}
+		ast_pg_t(const std::string_view file, const std::string_view tag) :
+			ast_decl_t(Node_kind::PG), tag(tag), file(file) {}
 
-		void set_name(const std::string& n) {
+		void set_name(const std::string_view n) {
 			name = n;
 		}
-		void print() {
-			std::cout << name << ": " << file << " -> " << tag << std::endl;
-		}
 
-		std::string get_name() {
+		std::string_view get_name() const {
 			return name;
 		}
 
-		std::string get_tag() {
+		std::string_view get_tag() const {
 			return tag;
 		}
 
-		std::string get_file() {
+		std::string_view get_file() const {
 			return file;
 		}
 	private:
-		std::string name;
-		std::string tag;
-		std::string file;
+		std::string_view name;
+		std::string_view tag;
+		std::string_view file;
 };
 
 class ast_source_t : public ast_node_t {
 	public:
-		ast_source_t() {}
-		void add_decl(const std::shared_ptr<ast_decl_t>& d) {
+		ast_source_t() : ast_node_t(Node_kind::SOURCE) {}
+		void add_decl(ast_decl_t *d) {
 			decls.push_back(d);
 		}
-		std::vector<std::shared_ptr<ast_decl_t>>& get_decls() {
+		const std::vector<ast_decl_t *>& get_decls() const {
 			return decls;
 		}
-		void print() {
-			for (auto& d : decls) {
-				d.get()->print();
-			}
-		}
 	private:
-		std::vector<std::shared_ptr<ast_decl_t>> decls;
-};
-
-class ast_decls_t : public ast_node_t {
-	public:
-		ast_decls_t() {};
-		std::vector<std::shared_ptr<ast_decl_t>>& get_decls() {
-			return decls;
-		}
-		void add(const std::shared_ptr<ast_decl_t>& d) {
-			decls.push_back(d);
-		}
-		void print() {
-			for (auto& d : decls) {
-				d.get()->print();
-			}
-		}
-	private:
-		std::vector<std::shared_ptr<ast_decl_t>> decls;
+		std::vector<ast_decl_t *> decls;
 };
 
 class ast_tag_t : public ast_expr_t {
 	public:
-		ast_tag_t();
-		ast_tag_t(const std::string& n) : name(n) {}
-		~ast_tag_t() {}
-		std::string& get_name() {
+		ast_tag_t(const std::string_view n) : ast_expr_t(Node_kind::TAG), name(n) {}
+		std::string_view get_name() const {
 			return name;
 		}
-		void print() {
-			std::cout << "\tTag '" << name << "'" << std::endl;
-		}
 	private:
-		std::string name;
+		std::string_view name;
 };
 
-class ast_edge_t : public ast_node_t {
-	public:
-		ast_edge_t(const std::string& s, const std::string& e) :
-			source(new ast_tag_t(s)), end(new ast_tag_t(e)) {}
-		void print() {
-			source.get()->print();
-			std::cout << "\t--->" << std::endl;
-			end.get()->print();
-		}
-		std::shared_ptr<ast_tag_t>& get_source() {
-			return source;
-		}
-		std::shared_ptr<ast_tag_t>& get_end() {
-			return end;
-		}
-	private:
-		std::shared_ptr<ast_tag_t> source;
-		std::shared_ptr<ast_tag_t> end;
-};
+typedef struct {
+	std::string_view source;
+	std::string_view end;
+} ast_edge_t;
 
 class ast_topology_basic_t : public ast_topology_t {
 	public:
-		void add_edge(const std::shared_ptr<ast_edge_t>& e) {
-			edges.push_back(e);
+		ast_topology_basic_t() : ast_topology_t(Node_kind::TOPOLOGY_BASIC) {}
+		void add_edge(const std::string_view source, const std::string_view end) {
+			edges.push_back({ source, end });
 		}
-		std::vector<std::shared_ptr<ast_edge_t>> get_edges() {
+		const std::vector<ast_edge_t>& get_edges() const {
 			return edges;
 		}
-		void print() {
-			std::cout << "Basic topology '" << name << "'" << std::endl;
-			std::cout << "Edges: " << std::endl;
-			for (auto& e : edges) {
-				e.get()->print();
-			}
-		}
 	private:
-		std::vector<std::shared_ptr<ast_edge_t>> edges;
+		std::vector<ast_edge_t> edges;
 };
 
 
-class ast_edges_t : public ast_node_t {
-	public:
-		void print() {
-			for (auto& e : edges) {
-				e.get()->print();
-			}
-		}
-		std::vector<std::shared_ptr<ast_edge_t>>& get_edges() {
-			return edges;
-		}
-		void add_edge(const std::shared_ptr<ast_edge_t>& e) {
-			edges.push_back(e);
-		}
-	private:
-		std::vector<std::shared_ptr<ast_edge_t>> edges;
-};
-
 class ast_topology_linear_t : public ast_topology_t {
 	public:
-		void add_tag(const std::shared_ptr<ast_tag_t>& t) {
+		ast_topology_linear_t() : ast_topology_t(Node_kind::TOPOLOGY_LINEAR) {}
+		void add_tag(const std::string_view t) {
 			tags.push_back(t);
 		}
-		std::vector<std::shared_ptr<ast_tag_t>>& get_tags() {
+		const std::vector<std::string_view>& get_tags() const {
 			return tags;
 		}
-		void print() {
-			std::cout << "Linear topology: " << std::endl;
-			for (auto& t : tags) {
-				t.get()->print();
-			}
-		}
 	private:
-		std::vector<std::shared_ptr<ast_tag_t>> tags;
+		std::vector<std::string_view> tags;
 };
 
 class ast_topology_expr_t : public ast_topology_t {
 	public:
-		ast_topology_expr_t(const std::shared_ptr<ast_expr_t>& e) : expr(e) {}
-		void print() {
-			std::cout << "Expr topology: '" << name << "'" << std::endl;
-			expr->print();
-		}
-		std::shared_ptr<ast_expr_t>& get_expr() {
+		ast_topology_expr_t(const ast_expr_t *e) :
+			ast_topology_t(Node_kind::TOPOLOGY_EXPR), expr(e) {}
+		const ast_expr_t *get_expr() const {
 			return expr;
 		}
 	private:
-		std::shared_ptr<ast_expr_t> expr;
+		const ast_expr_t *expr;
 };
 
 class ast_expr_bin_t : public ast_expr_t {
@@ -225,40 +194,26 @@ class ast_expr_bin_t : public ast_expr_t {
 			SUM,
 			MUL
 		};
-		ast_expr_bin_t(const Oper o, const std::shared_ptr<ast_expr_t>& l, const std::shared_ptr<ast_expr_t>& r)
-			: oper(o), lhs(l), rhs(r) {}
+		ast_expr_bin_t(const Oper o, const ast_expr_t *l, const ast_expr_t *r) :
+			ast_expr_t(Node_kind::EXPR_BIN), oper(o), lhs(l), rhs(r) {}
 
-		void set_lhs(const std::shared_ptr<ast_expr_t>& l) {
-			lhs = l;
-		}
-		std::shared_ptr<ast_expr_t>& get_lhs() {
+		const ast_expr_t *get_lhs() const {
 			return lhs;
 		}
 
-		void set_rhs(const std::shared_ptr<ast_expr_t>& r) {
-			rhs = r;
-		}
-		std::shared_ptr<ast_expr_t>& get_rhs() {
+		const ast_expr_t *get_rhs() const {
 			return rhs;
 		}
 
-		Oper get_oper() {
+		Oper get_oper() const {
 			return oper;
 		}
-
-		void print() {
-			std::cout << "\tLeft side:" << std::endl << "\t";
-			lhs.get()->print();
-			std::cout << "\t\t" << (oper == Oper::MUL ? "*" : "+") << std::endl << "\t";
-			std::cout << "\tRight side:" << std::endl << "\t";
-			rhs.get()->print();
-		}
 	private:
 		Oper oper;
-		std::shared_ptr<ast_expr_t> lhs;
-		std::shared_ptr<ast_expr_t> rhs;
+		const ast_expr_t *lhs;
+		const ast_expr_t *rhs;
 };
 
-std::shared_ptr<ast_node_t> ast_construct(const dertree_t& node, std::shared_ptr<ast_node_t> arg);
+void ast_print(const ast_node_t *node);
 
 #endif
@@ -0,0 +1,59 @@
+#include "bit_matrix.h"
+
+
+size_t bit_matrix_t::next(const size_t i, const size_t j) const {
+	if (j >= n) {
+		return n;
+	}
+	const uint64_t *r = row(i);
+	size_t w = j / 64;
+	uint64_t word = r[w] & (~(uint64_t) 0 << (j % 64));
+	while (word == 0) {
+		if (++w == stride) {
+			return n;
+		}
+		word = r[w];
+	}
+	return w * 64 + __builtin_ctzll(word);
+}
+
+size_t bit_matrix_t::last_common(const size_t i, const size_t j) const {
+	const uint64_t *a = row(i);
+	const uint64_t *b = row(j);
+	for (size_t w = stride; w-- > 0;) {
+		uint64_t word = a[w] & b[w];
+		if (word != 0) {
+			return w * 64 + 63 - __builtin_clzll(word);
+		}
+	}
+	return n;
+}
+
+void bit_matrix_t::fill_row(const size_t i) {
+	uint64_t *r = row(i);
+	for (size_t w = 0; w < stride; w++) {
+		r[w] = ~(uint64_t) 0;
+	}
+	if (n % 64 != 0) {
+		r[stride - 1] = ((uint64_t) 1 << (n % 64)) - 1;
+	}
+}
+
+void bit_matrix_t::or_bits(const size_t i, const size_t offset, const uint64_t *src, const size_t count) {
+	uint64_t *r = row(i);
+	size_t shift = offset % 64;
+	size_t base = offset / 64;
+	// bits past count are zero in src, so whole words can be shifted in
+	for (size_t w = 0; w < (count + 63) / 64; w++) {
+		r[base + w] |= src[w] << shift;
+		if (shift != 0 && base + w + 1 < stride) {
+			r[base + w + 1] |= src[w] >> (64 - shift);
+		}
+	}
+}
+
+void bit_matrix_t::or_block(const size_t offset, const bit_matrix_t& m) {
+	for (size_t i = 0; i < m.size(); i++) {
+		or_bits(offset + i, offset, m.row(i), m.size());
+	}
+}
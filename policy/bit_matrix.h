@@ -0,0 +1,54 @@
+#ifndef _POLICY_BIT_MATRIX_H_
+#define _POLICY_BIT_MATRIX_H_
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+/* Square boolean matrix with one bit per entry. Rows are padded to whole
+ * 64-bit words and stored back to back in a single allocation. Padding
+ * bits past the last column are always zero. */
+class bit_matrix_t {
+	public:
+		bit_matrix_t() : n(0), stride(0) {}
+		bit_matrix_t(const size_t n) :
+			n(n), stride((n + 63) / 64), bits(n * ((n + 63) / 64)) {}
+
+		size_t size() const {
+			return n;
+		}
+		// number of words per row
+		size_t words() const {
+			return stride;
+		}
+		bool test(const size_t i, const size_t j) const {
+			return (bits[i * stride + j / 64] >> (j % 64)) & 1;
+		}
+		void set(const size_t i, const size_t j) {
+			bits[i * stride + j / 64] |= (uint64_t) 1 << (j % 64);
+		}
+		uint64_t *row(const size_t i) {
+			return bits.data() + i * stride;
+		}
+		const uint64_t *row(const size_t i) const {
+			return bits.data() + i * stride;
+		}
+
+		// first set column of row i at or after column j, size() if none
+		size_t next(const size_t i, const size_t j) const;
+		// last column set in both row i and row j, size() if none
+		size_t last_common(const size_t i, const size_t j) const;
+		// sets every column of row i
+		void fill_row(const size_t i);
+		// ORs count bits of src into row i, starting at column offset
+		void or_bits(const size_t i, const size_t offset, const uint64_t *src, const size_t count);
+		// ORs m into the diagonal block starting at (offset, offset)
+		void or_block(const size_t offset, const bit_matrix_t& m);
+	private:
+		size_t n;
+		size_t stride;
+		std::vector<uint64_t> bits;
+};
+
+#endif
@@ -1,169 +1,432 @@
 #include "lca.h"
 
-#include <list>
 #include <iostream>
 #include <string>
 #include <sstream>
-#include <map>
+#include <algorithm>
+#include <thread>
 
 
-static std::vector<std::vector<uint8_t>> reverse_graph(
-	const std::vector<std::vector<uint8_t>>& m);
-static std::vector<std::vector<uint8_t>> preprocess_first(
-	const std::vector<std::vector<uint8_t>>& m);
-static std::vector<std::vector<uint8_t>> preprocess_second(
-	const std::vector<std::vector<uint8_t>>& m,
-	const std::vector<std::vector<uint8_t>>& desc);
+// tables with fewer rows per thread are built serially
+static const size_t min_rows_per_thread = 64;
 
-static std::vector<int> get_sources(
-	const std::vector<std::vector<uint8_t>>& m,
-	const std::list<int>& indexes);
-static std::vector<int> get_terminals(
-	const std::vector<std::vector<uint8_t>>& m,
-	std::list<int> indexes);
 
+enum class Shape {
+	CHAIN,
+	TREE,
+	DAG
+};
 
+
+template<typename F>
+static void parallel_rows(const size_t n, F f);
+static Shape classify(const bit_matrix_t& m, std::vector<int>& parent);
+static std::vector<std::vector<uint8_t>> chain_lca(const std::vector<int>& parent);
+static std::vector<std::vector<uint8_t>> tree_lca(const std::vector<int>& parent);
+static std::vector<std::vector<size_t>> weak_components(const bit_matrix_t& m);
+static size_t find_root(std::vector<size_t>& parent, size_t i);
+static bit_matrix_t reverse_graph(const bit_matrix_t& m);
+static std::vector<uint8_t> number_vertices(
+	const bit_matrix_t& m,
+	const bit_matrix_t& rm);
+static bit_matrix_t ancestor_sets(
+	const bit_matrix_t& m,
+	const std::vector<uint8_t>& number_to_index);
+
+
+/* The vertices are numbered level by level from the top and every vertex
+ * gets the set of its upper bounds in that numbering. The LCA of two
+ * vertices is the last numbered common upper bound, the highest bit of
+ * the intersection of their sets. */
 std::vector<std::vector<uint8_t>> compute_lca(
-		const std::vector<std::vector<uint8_t>>& m) {
+		const bit_matrix_t& m) {
+	size_t n = m.size();
 	auto transposed = reverse_graph(m);
-	auto closure = preprocess_first(transposed);
-	return preprocess_second(transposed, closure);
+	auto number_to_index = number_vertices(m, transposed);
+	auto ancestors = ancestor_sets(m, number_to_index);
+
+	std::vector<std::vector<uint8_t>> lca_matrix(
+		n, std::vector<uint8_t>(n, TAG_INVALID));
+	parallel_rows(n, [&](const size_t begin, const size_t end) {
+		for (size_t x = begin; x < end; x++) {
+			auto& row = lca_matrix[number_to_index[x]];
+			for (size_t y = 0; y < n; y++) {
+				size_t common = ancestors.last_common(x, y);
+				if (common < n) {
+					row[number_to_index[y]] = number_to_index[common];
+				}
+			}
+		}
+	});
+	return lca_matrix;
 }
 
 
-// reverse the graph edges by transposing the matrix
-static std::vector<std::vector<uint8_t>> reverse_graph(
-		const std::vector<std::vector<uint8_t>>& m) {
-	auto rm = std::vector<std::vector<uint8_t>>(
-		m.size(), std::vector<uint8_t>(m.size()));
+/* Vertices of different components have no common upper bound, so their
+ * entries stay invalid. */
+std::vector<std::vector<uint8_t>> compute_component_lca(
+		const bit_matrix_t& m) {
+	size_t n = m.size();
+	std::vector<std::vector<uint8_t>> lca_matrix(
+		n, std::vector<uint8_t>(n, TAG_INVALID));
+	std::vector<size_t> local(n);
 
-	for (size_t i = 0; i < m.size(); i++) {
-		for (size_t j = 0; j < m.size(); j++) {
-			rm[j][i] = m[i][j];
+	for (auto& vertices : weak_components(m)) {
+		size_t k = vertices.size();
+		for (size_t i = 0; i < k; i++) {
+			local[vertices[i]] = i;
+		}
+		bit_matrix_t sub(k);
+		for (size_t i = 0; i < k; i++) {
+			size_t v = vertices[i];
+			for (size_t j = m.next(v, 0); j < n; j = m.next(v, j + 1)) {
+				sub.set(i, local[j]);
+			}
 		}
-	}
 
-	return rm;
+		std::vector<int> parent;
+		std::vector<std::vector<uint8_t>> table;
+		switch (classify(sub, parent)) {
+			case Shape::CHAIN:
+				table = chain_lca(parent);
+				break;
+			case Shape::TREE:
+				table = tree_lca(parent);
+				break;
+			default:
+				table = compute_lca(sub);
+				break;
+		}
+		for (size_t i = 0; i < k; i++) {
+			auto& row = lca_matrix[vertices[i]];
+			for (size_t j = 0; j < k; j++) {
+				if (table[i][j] != TAG_INVALID) {
+					row[vertices[j]] = vertices[table[i][j]];
+				}
+			}
+		}
+	}
+	return lca_matrix;
 }
 
-static std::vector<std::vector<uint8_t>> preprocess_first(
-		const std::vector<std::vector<uint8_t>>& m) {
-	std::vector<std::vector<uint8_t>> r(m.size(), std::vector<uint8_t>(m.size()));
-
-	std::list<int> indexes;
-	for (size_t i = 0; i < m.size(); i++) {
-		indexes.push_back(i);
-	}
-
-	std::vector<int> terminals = get_terminals(m, indexes);
-	std::vector<int> last_deleted;
-	while (terminals.size() > 0) {
-		for (auto& i : terminals) {
-			r[i][i] = 1;
-			for (auto& row : last_deleted) {
-				if (m[i][row] > 0) {
-					for (size_t j = 0; j < r.size(); j++) {
-						r[i][j] |= r[row][j];
-					}
-				}
+
+/* A connected DAG where every vertex has at most one upper bound other
+ * than itself is a tree with the root at the top, parent is its upper
+ * bound or -1. If no vertex has two lower bounds either, it is a chain. */
+static Shape classify(const bit_matrix_t& m, std::vector<int>& parent) {
+	size_t n = m.size();
+	parent.assign(n, -1);
+	std::vector<int> children(n);
+	bool chain = true;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = m.next(i, 0); j < n; j = m.next(i, j + 1)) {
+			if (i == j) {
+				continue;
+			}
+			if (parent[i] >= 0) {
+				return Shape::DAG;
 			}
-			indexes.remove(i);
+			parent[i] = j;
+			chain = chain && ++children[j] == 1;
 		}
-		last_deleted.clear();
-		last_deleted = terminals;
+	}
+	return chain ? Shape::CHAIN : Shape::TREE;
+}
 
-		terminals = get_terminals(m, indexes);
+// the LCA is the one of the two tags that is higher in the chain
+static std::vector<std::vector<uint8_t>> chain_lca(const std::vector<int>& parent) {
+	size_t n = parent.size();
+	std::vector<int> height(n, -1);
+	std::vector<int> path;
+	for (size_t i = 0; i < n; i++) {
+		// tags higher in the chain get larger heights
+		int v = i;
+		while (v >= 0 && height[v] < 0) {
+			path.push_back(v);
+			v = parent[v];
+		}
+		int h = v < 0 ? n : height[v];
+		for (auto p = path.rbegin(); p != path.rend(); p++) {
+			height[*p] = --h;
+		}
+		path.clear();
 	}
 
+	std::vector<std::vector<uint8_t>> r(n, std::vector<uint8_t>(n));
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			r[i][j] = height[i] >= height[j] ? i : j;
+		}
+	}
 	return r;
 }
 
+/* Euler tour of the tree from the root, the LCA of two tags is the
+ * shallowest tag visited between their first visits. The minimum over a
+ * range is answered from a sparse table of power of two ranges. */
+static std::vector<std::vector<uint8_t>> tree_lca(const std::vector<int>& parent) {
+	size_t n = parent.size();
+	std::vector<std::vector<int>> children(n);
+	int root = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (parent[i] < 0) {
+			root = i;
+		} else {
+			children[parent[i]].push_back(i);
+		}
+	}
 
-static std::vector<std::vector<uint8_t>> preprocess_second(
-		const std::vector<std::vector<uint8_t>>& m,
-		const std::vector<std::vector<uint8_t>>& desc) {
-	std::vector<std::vector<int>> r(m.size(), std::vector<int>(m.size(), -1));
-
-	std::list<int> indexes;
-	for (size_t i = 0; i < m.size(); i++) {
-		indexes.push_back(i);
-	}
-	std::list<int> deleted;
-	std::vector<int> sources = get_sources(m, indexes);
-	int numbering = 0;
-	std::map<int, uint8_t> number_to_index = {{-1, TAG_INVALID}};
-	while (sources.size() > 0) {
-		for (auto& s : sources) {
-			number_to_index[numbering] = s;
-			for (size_t j = 0; j < r.size(); j++) {
-				if (desc[s][j] > 0) {
-					r[s][j] = numbering;
-				}
+	std::vector<int> euler;
+	std::vector<int> depth;
+	std::vector<int> first(n);
+	euler.reserve(2 * n);
+	depth.reserve(2 * n);
+	// (vertex, next child) pairs of the current path
+	std::vector<std::pair<int, size_t>> stack = { { root, 0 } };
+	first[root] = 0;
+	euler.push_back(root);
+	depth.push_back(0);
+	while (stack.size() > 0) {
+		auto& top = stack.back();
+		if (top.second < children[top.first].size()) {
+			int child = children[top.first][top.second++];
+			first[child] = euler.size();
+			stack.push_back({ child, 0 });
+		} else {
+			stack.pop_back();
+			if (stack.size() == 0) {
+				break;
 			}
-			for (auto& ancestor : deleted) {
-				if (m[ancestor][s] > 0) {
-					for (size_t j = 0; j < r.size(); j++) {
-						if (r[ancestor][j] > r[s][j]) {
-							r[s][j] = r[ancestor][j];
-						}
-					}
-				}
+		}
+		euler.push_back(stack.back().first);
+		depth.push_back(stack.size() - 1);
+	}
+
+	// sparse[k][i] is the position of the minimum depth in [i, i + 2^k)
+	size_t len = euler.size();
+	std::vector<std::vector<int>> sparse = { std::vector<int>(len) };
+	for (size_t i = 0; i < len; i++) {
+		sparse[0][i] = i;
+	}
+	for (size_t k = 1; ((size_t) 1 << k) <= len; k++) {
+		auto& prev = sparse[k - 1];
+		size_t half = (size_t) 1 << (k - 1);
+		std::vector<int> level(len - 2 * half + 1);
+		for (size_t i = 0; i < level.size(); i++) {
+			int a = prev[i];
+			int b = prev[i + half];
+			level[i] = depth[b] < depth[a] ? b : a;
+		}
+		sparse.push_back(std::move(level));
+	}
+
+	std::vector<std::vector<uint8_t>> r(n, std::vector<uint8_t>(n));
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			size_t lo = std::min(first[i], first[j]);
+			size_t hi = std::max(first[i], first[j]);
+			size_t k = 63 - __builtin_clzll(hi - lo + 1);
+			int a = sparse[k][lo];
+			int b = sparse[k][hi + 1 - ((size_t) 1 << k)];
+			r[i][j] = euler[depth[b] < depth[a] ? b : a];
+		}
+	}
+	return r;
+}
+
+// union-find over the edges, vertices are listed in ascending order
+static std::vector<std::vector<size_t>> weak_components(const bit_matrix_t& m) {
+	size_t n = m.size();
+	std::vector<size_t> parent(n);
+	for (size_t i = 0; i < n; i++) {
+		parent[i] = i;
+	}
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = m.next(i, 0); j < n; j = m.next(i, j + 1)) {
+			size_t a = find_root(parent, i);
+			size_t b = find_root(parent, j);
+			if (a != b) {
+				parent[std::max(a, b)] = std::min(a, b);
 			}
+		}
+	}
 
-			deleted.push_back(s);
-			indexes.remove(s);
-			numbering++;
+	std::vector<std::vector<size_t>> components;
+	std::vector<size_t> component(n);
+	for (size_t i = 0; i < n; i++) {
+		size_t root = find_root(parent, i);
+		if (root == i) {
+			component[i] = components.size();
+			components.emplace_back();
 		}
+		components[component[root]].push_back(i);
+	}
+	return components;
+}
 
-		sources = get_sources(m, indexes);
+static size_t find_root(std::vector<size_t>& parent, size_t i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
 	}
+	return i;
+}
 
-	std::vector<std::vector<uint8_t>> lca_matrix(
-		m.size(), std::vector<uint8_t>(m.size(), TAG_INVALID));
-	for (size_t i = 0; i < r.size(); i++) {
-		for (size_t j = 0; j < r.size(); j++) {
-			lca_matrix[i][j] = number_to_index[r[i][j]];
+
+/* Splits the rows [0, n) into contiguous ranges and calls f(begin, end)
+ * for each of them on its own thread. Every row is written by exactly one
+ * thread, so the result doesn't depend on the scheduling. */
+template<typename F>
+static void parallel_rows(const size_t n, F f) {
+	size_t k = std::min<size_t>(std::thread::hardware_concurrency(), n / min_rows_per_thread);
+	k = std::max<size_t>(k, 1);
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < k; i++) {
+		workers.emplace_back(f, n * i / k, n * (i + 1) / k);
+	}
+	f(0, n / k);
+	for (auto& w : workers) {
+		w.join();
+	}
+}
+
+
+// reverse the graph edges by transposing the matrix
+static bit_matrix_t reverse_graph(const bit_matrix_t& m) {
+	size_t n = m.size();
+	bit_matrix_t rm(n);
+
+	// every thread fills the rows of rm from its range of columns of m
+	parallel_rows(n, [&](const size_t begin, const size_t end) {
+		for (size_t i = 0; i < n; i++) {
+			for (size_t j = m.next(i, begin); j < end; j = m.next(i, j + 1)) {
+				rm.set(j, i);
+			}
+		}
+	});
+
+	return rm;
+}
+
+/* Kahn ordering from the top, in ascending order of indexes within a
+ * level. A vertex moves to the next level once the counter of its upper
+ * bounds that are not numbered yet drops to zero. */
+static std::vector<uint8_t> number_vertices(
+		const bit_matrix_t& m,
+		const bit_matrix_t& rm) {
+	size_t n = m.size();
+	std::vector<int> degree(n);
+	std::vector<int> level;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = m.next(i, 0); j < n; j = m.next(i, j + 1)) {
+			degree[i] += i != j;
+		}
+		if (degree[i] == 0) {
+			level.push_back(i);
 		}
 	}
 
-	return lca_matrix;
+	std::vector<uint8_t> number_to_index;
+	number_to_index.reserve(n);
+	std::vector<int> next_level;
+	while (level.size() > 0) {
+		for (auto s : level) {
+			number_to_index.push_back(s);
+			for (size_t j = rm.next(s, 0); j < n; j = rm.next(s, j + 1)) {
+				if (j != (size_t) s && --degree[j] == 0) {
+					next_level.push_back(j);
+				}
+			}
+		}
+
+		std::sort(next_level.begin(), next_level.end());
+		level.swap(next_level);
+		next_level.clear();
+	}
+
+	return number_to_index;
 }
 
+/* Row and columns are vertex numbers. The upper bounds of a vertex are
+ * numbered before it, so their rows are complete when they are ORed in. */
+static bit_matrix_t ancestor_sets(
+		const bit_matrix_t& m,
+		const std::vector<uint8_t>& number_to_index) {
+	size_t n = m.size();
+	std::vector<int> index_to_number(n);
+	for (size_t i = 0; i < number_to_index.size(); i++) {
+		index_to_number[number_to_index[i]] = i;
+	}
 
-static std::vector<int> get_terminals(
-		const std::vector<std::vector<uint8_t>>& m,
-		std::list<int> indexes) {
-	std::vector<int> r;
-	for (auto& i : indexes) {
-		bool terminal = true;
-		for (auto& j : indexes) {
-			if (i != j && m[i][j] > 0) {
-				terminal = false;
-				break;
+	bit_matrix_t r(n);
+	for (size_t i = 0; i < number_to_index.size(); i++) {
+		size_t s = number_to_index[i];
+		r.set(i, i);
+		for (size_t a = m.next(s, 0); a < n; a = m.next(s, a + 1)) {
+			if (a != s) {
+				r.or_bits(i, 0, r.row(index_to_number[a]), n);
 			}
 		}
-		if (terminal) {
-			r.push_back(i);
+	}
+	return r;
+}
+
+std::vector<std::vector<uint8_t>> lca_chain(const size_t n) {
+	std::vector<std::vector<uint8_t>> r(n, std::vector<uint8_t>(n));
+	for (size_t i = 0; i < n; i++) {
+		for (size_t j = 0; j < n; j++) {
+			r[i][j] = std::max(i, j);
 		}
 	}
 	return r;
 }
 
-static std::vector<int> get_sources(
-		const std::vector<std::vector<uint8_t>>& m,
-		const std::list<int>& indexes) {
-	std::vector<int> r;
-	for (auto& i : indexes) {
-		bool source = true;
-		for (auto& j : indexes) {
-			if (i != j && m[j][i] > 0) {
-				source = false;
-				break;
+std::vector<std::vector<uint8_t>> lca_sum(
+		const std::vector<std::vector<uint8_t>>& a,
+		const std::vector<std::vector<uint8_t>>& b) {
+	size_t n = a.size();
+	std::vector<std::vector<uint8_t>> r(
+		n + b.size(), std::vector<uint8_t>(n + b.size(), TAG_INVALID));
+	lca_place(r, 0, a);
+	lca_place(r, n, b);
+	return r;
+}
+
+/* The upper bounds of (a, b) and (a', b') are the pairs of upper bounds of
+ * the components. Both the level and the index of a pair grow with the
+ * level and the index of its components, so the last numbered common upper
+ * bound is the pair of the last numbered ones. */
+std::vector<std::vector<uint8_t>> lca_product(
+		const std::vector<std::vector<uint8_t>>& a,
+		const std::vector<std::vector<uint8_t>>& b) {
+	size_t n = a.size();
+	size_t m = b.size();
+	std::vector<std::vector<uint8_t>> r(n * m, std::vector<uint8_t>(n * m));
+	for (size_t i = 0; i < n; i++) {
+		for (size_t bi = 0; bi < m; bi++) {
+			auto& row = r[i * m + bi];
+			for (size_t j = 0; j < n; j++) {
+				for (size_t bj = 0; bj < m; bj++) {
+					uint8_t x = a[i][j];
+					uint8_t y = b[bi][bj];
+					row[j * m + bj] = x == TAG_INVALID || y == TAG_INVALID
+						? TAG_INVALID : x * m + y;
+				}
 			}
 		}
-		if (source) {
-			r.push_back(i);
-		}
 	}
 	return r;
 }
+
+void lca_place(
+		std::vector<std::vector<uint8_t>>& r,
+		const size_t offset,
+		const std::vector<std::vector<uint8_t>>& t) {
+	for (size_t i = 0; i < t.size(); i++) {
+		for (size_t j = 0; j < t.size(); j++) {
+			r[offset + i][offset + j] = t[i][j] == TAG_INVALID
+				? TAG_INVALID : t[i][j] + offset;
+		}
+	}
+}
@@ -4,9 +4,32 @@
 #include <vector>
 #include <stdint.h>
 
+#include "bit_matrix.h"
+
 #define TAG_INVALID ((uint8_t) ((1 << 8) - 1))
 
 
-std::vector<std::vector<uint8_t>> compute_lca(const std::vector<std::vector<uint8_t>>& m);
+std::vector<std::vector<uint8_t>> compute_lca(const bit_matrix_t& m);
+// runs compute_lca on every weakly connected component of m separately
+std::vector<std::vector<uint8_t>> compute_component_lca(const bit_matrix_t& m);
+
+/* LCA tables of composed topologies, built from the tables of their parts.
+ * Entries are indexes local to the topology. */
+
+// chain where every tag is below the next one
+std::vector<std::vector<uint8_t>> lca_chain(const size_t n);
+// disjoint union, tags of different operands have no common upper bound
+std::vector<std::vector<uint8_t>> lca_sum(
+	const std::vector<std::vector<uint8_t>>& a,
+	const std::vector<std::vector<uint8_t>>& b);
+// cartesian product, the LCA is taken componentwise
+std::vector<std::vector<uint8_t>> lca_product(
+	const std::vector<std::vector<uint8_t>>& a,
+	const std::vector<std::vector<uint8_t>>& b);
+// copies t into r with its top left corner and its entries shifted by offset
+void lca_place(
+	std::vector<std::vector<uint8_t>>& r,
+	const size_t offset,
+	const std::vector<std::vector<uint8_t>>& t);
 
 #endif
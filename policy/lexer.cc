@@ -1,120 +1,143 @@
 #include "lexer.h"
 
 #include <iostream>
-#include <fstream>
 #include <sstream>
 #include <exception>
+#include <array>
 
 
-static inline bool is_whitespace(const char c);
-static inline bool is_identifier(const char c);
+static constexpr std::array<bool, 256> identifier_chars() {
+	std::array<bool, 256> table = {};
+	for (int c = 0; c < 256; c++) {
+		table[c] = (c >= 'a' && c <= 'z') ||
+			(c >= 'A' && c <= 'Z') ||
+			(c >= '0' && c <= '9') ||
+			(c == '_') || (c == '.');
+	}
+	return table;
+}
 
-std::vector<symbol_t> lexify(const char *file_path) {
-	std::ifstream infile(file_path);
-	char c = 0;
-	std::vector<symbol_t> symbols;
+static constexpr std::array<bool, 256> is_identifier = identifier_chars();
 
-	if (!infile.is_open()) {
-		std::ostringstream oss;
-		oss << "Couldn't open policy file: '" << file_path << "'!";
-		throw std::invalid_argument(oss.str());
-	}
+static inline Term keyword(const std::string_view s);
 
+std::vector<symbol_t> lexify(const std::string_view source) {
+	std::vector<symbol_t> symbols;
+	symbols.reserve(source.size() / 8 + 1);
+
+	const size_t n = source.size();
+	size_t i = 0;
 	int line = 1;
 	int column = 0;
-	while (infile.get(c)) {
+	while (i < n) {
+		const char c = source[i];
 		column++;
 
-		if (is_whitespace(c)) {
-			if (c == '\t') {
+		switch (c) {
+			case ' ':
+			case '\r':
+				i++;
+				continue;
+			case '\t':
 				column = column + 8 - (column % 8);
-			} else if (c == '\n') {
-				line += 1;
+				i++;
+				continue;
+			case '\n':
+				line++;
 				column = 0;
+				i++;
+				continue;
+			case '#': {
+				size_t nl = source.find('\n', i);
+				i = (nl == std::string_view::npos) ? n : nl + 1;
+				line++;
+				column = 0;
+				continue;
 			}
-			continue;
-		} else if (c == '#') {
-			do {
-				infile.get(c);
-			} while ((c != '\n') && !infile.eof());
-			line++;
-			column = 0;
-		} else if (c == '{') {
-			symbols.push_back({ Term::LBRACE, "{", line, column });
-		} else if (c == '}') {
-			symbols.push_back({ Term::RBRACE, "}", line, column });
-		} else if (c == '(') {
-			symbols.push_back({ Term::LPAREN, "(", line, column });
-		} else if (c == ')') {
-			symbols.push_back({ Term::RPAREN, ")", line, column });
-		} else if (c == ':') {
-			symbols.push_back({ Term::COLON, ":", line, column });
-		} else if (c == ',') {
-			symbols.push_back({ Term::COMMA, ",", line, column });
-		} else if (c == '+') {
-			symbols.push_back({ Term::PLUS, "+", line, column });
-		} else if (c == '*') {
-			symbols.push_back({ Term::MULT, "*", line, column });
-		} else if (c == '=') {
-			symbols.push_back({ Term::EQUAL, "=", line, column});
-		} else if (c == '-') {
-			infile.get(c);
-			column++;
-			if (c == '>') {
-				symbols.push_back({ Term::ARROW, "->", line, column - 1 });
-			} else {
-				std::ostringstream oss;
-				oss << "Expected an arrow, got '" << c << "', location: "
-					<< line << ", " << column;
-				throw std::runtime_error(oss.str());
-			}
-		} else if (c == '"') {
-			std::string s;
-			int start_column = column;
-			while (infile.get(c) && c != '"') {
-				if (c == '\n') {
+			case '{':
+				symbols.push_back({ Term::LBRACE, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case '}':
+				symbols.push_back({ Term::RBRACE, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case '(':
+				symbols.push_back({ Term::LPAREN, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case ')':
+				symbols.push_back({ Term::RPAREN, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case ':':
+				symbols.push_back({ Term::COLON, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case ',':
+				symbols.push_back({ Term::COMMA, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case '+':
+				symbols.push_back({ Term::PLUS, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case '*':
+				symbols.push_back({ Term::MULT, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case '=':
+				symbols.push_back({ Term::EQUAL, source.substr(i, 1), line, column });
+				i++;
+				continue;
+			case '-':
+				column++;
+				if (i + 1 < n && source[i + 1] == '>') {
+					symbols.push_back({ Term::ARROW, source.substr(i, 2), line, column - 1 });
+					i += 2;
+					continue;
+				} else {
 					std::ostringstream oss;
-					oss << "String literal does not end before the end of the line! Location: "
-						<< line << "," << column;
+					oss << "Expected an arrow, got '" << (i + 1 < n ? source[i + 1] : c) << "', location: "
+						<< line << ", " << column;
 					throw std::runtime_error(oss.str());
 				}
+			case '"': {
+				int start_column = column;
+				size_t start = ++i;
+				while (i < n && source[i] != '"') {
+					if (source[i] == '\n') {
+						std::ostringstream oss;
+						oss << "String literal does not end before the end of the line! Location: "
+							<< line << "," << column;
+						throw std::runtime_error(oss.str());
+					}
+					column++;
+					i++;
+				}
 				column++;
-				s += c;
+				symbols.push_back({ Term::STRING, source.substr(start, i - start), line, start_column });
+				i++;
+				continue;
 			}
-			column++;
-			symbols.push_back({ Term::STRING, s, line, start_column });
-		} else if (is_identifier(c)) {
-			std::string s;
-			int start_column = column;
-			do {
-				s += c;
-				infile.get(c);
-				column++;
-			} while (is_identifier(c) && !infile.eof());
-			infile.unget();
-			column--;
+			default:
+				break;
+		}
 
-			if (s == "basic") {
-				symbols.push_back({ Term::BASIC, s, line, start_column });
-			} else if (s == "linear") {
-				symbols.push_back({ Term::LINEAR, s, line, start_column });
-			} else if (s == "expr") {
-				symbols.push_back({ Term::EXPR, s, line, start_column });
-			} else if (s == "topology") {
-				symbols.push_back({ Term::TOPOLOGY, s, line, start_column });
-			} else if (s == "pg") {
-				symbols.push_back({ Term::PG, s, line, start_column });
-			} else if (s == "file") {
-				symbols.push_back({ Term::PG_FILE, s, line, start_column});
-			} else {
-				symbols.push_back({ Term::IDENTIFIER, s, line, start_column });
-			}
-		} else {
+		if (!is_identifier[(uint8_t) c]) {
 			std::ostringstream oss;
 			oss << "Failed to parse at character '" << c << "', location: "
 				<< line << ", " << column;
 			throw std::runtime_error(oss.str());
 		}
+
+		size_t start = i;
+		while (i < n && is_identifier[(uint8_t) source[i]]) {
+			i++;
+		}
+		std::string_view s = source.substr(start, i - start);
+		symbols.push_back({ keyword(s), s, line, column });
+		column += s.size() - 1;
 	}
 
 	symbols.push_back({ Term::END, "end of file", line, column });
@@ -122,13 +145,36 @@ std::vector<symbol_t> lexify(const char *file_path) {
 	return symbols;
 }
 
-static inline bool is_whitespace(const char c) {
-	return c == '\t' || c == '\n' || c == ' ' || c == '\r';
-}
-
-static inline bool is_identifier(const char c) {
-	return (c >= 'a' && c <= 'z') ||
-		(c >= 'A' && c <= 'Z') ||
-		(c >= '0' && c <= '9') ||
-		(c == '_') || (c == '.');
+// keywords have distinct lengths apart from "expr" and "file"
+static inline Term keyword(const std::string_view s) {
+	switch (s.size()) {
+		case 2:
+			if (s == "pg") {
+				return Term::PG;
+			}
+			break;
+		case 4:
+			if (s == "expr") {
+				return Term::EXPR;
+			} else if (s == "file") {
+				return Term::PG_FILE;
+			}
+			break;
+		case 5:
+			if (s == "basic") {
+				return Term::BASIC;
+			}
+			break;
+		case 6:
+			if (s == "linear") {
+				return Term::LINEAR;
+			}
+			break;
+		case 8:
+			if (s == "topology") {
+				return Term::TOPOLOGY;
+			}
+			break;
+	}
+	return Term::IDENTIFIER;
 }
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 enum class Term {
 	LBRACE,
@@ -27,14 +28,15 @@ enum class Term {
 	END
 };
 
+/* Names are views into the lexed source, which has to outlive the symbols. */
 struct symbol_t {
 	Term term;
-	std::string name;
+	std::string_view name;
 	int line;
 	int column;
 };
 
 
-std::vector<symbol_t> lexify(const char *file_path);
+std::vector<symbol_t> lexify(const std::string_view source);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "mapped_file.h"
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+mapped_file_t::mapped_file_t(const char *file_path) :
+		addr(nullptr), length(0) {
+	int fd = open(file_path, O_RDONLY);
+	if (fd < 0) {
+		std::ostringstream oss;
+		oss << "Unable to open '" << file_path << "'! Error: " << strerror(errno);
+		throw std::invalid_argument(oss.str());
+	}
+
+	struct stat file_status;
+	if (fstat(fd, &file_status) != 0) {
+		std::ostringstream oss;
+		oss << "Failed to read data from '" << file_path << "'! Error: " << strerror(errno);
+		close(fd);
+		throw std::runtime_error(oss.str());
+	}
+	length = file_status.st_size;
+
+	// mmap refuses empty mappings, an empty file is just an empty view
+	if (length > 0) {
+		void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) {
+			std::ostringstream oss;
+			oss << "Failed to map '" << file_path << "'! Error: " << strerror(errno);
+			close(fd);
+			throw std::runtime_error(oss.str());
+		}
+		addr = (const char *) p;
+	}
+
+	// the mapping stays valid after the descriptor is closed
+	if (close(fd) < 0) {
+		std::cerr << "Failed to close file descriptor! Error: " << strerror(errno) << std::endl;
+	}
+}
+
+mapped_file_t::~mapped_file_t() {
+	if (addr != nullptr) {
+		munmap((void *) addr, length);
+	}
+}
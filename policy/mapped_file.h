@@ -0,0 +1,31 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string_view>
+#include <cstddef>
+
+
+/* Read-only memory mapping of a whole file. The mapping lives as long as
+ * the object, so views handed out by it must not outlive it. */
+class mapped_file_t {
+	public:
+		mapped_file_t(const char *file_path);
+		~mapped_file_t();
+		mapped_file_t(const mapped_file_t&) = delete;
+		mapped_file_t& operator=(const mapped_file_t&) = delete;
+
+		const char *data() const {
+			return addr;
+		}
+		size_t size() const {
+			return length;
+		}
+		std::string_view view() const {
+			return std::string_view(addr, length);
+		}
+	private:
+		const char *addr;
+		size_t length;
+};
+
+#endif /* _MAPPED_FILE_H_ */
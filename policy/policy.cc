@@ -1,5 +1,6 @@
 #include "policy.h"
 
+#include "mapped_file.h"
 #include "lexer.h"
 #include "synan.h"
 #include "ast.h"
@@ -12,419 +13,418 @@
 #include <list>
 
 
-static std::map<std::string, std::shared_ptr<topology_t>> get_simple_topologies(const std::shared_ptr<ast_node_t>& ast);
+static std::map<std::string, std::shared_ptr<topology_t>> get_simple_topologies(const ast_source_t& source);
 static std::map<std::string, std::shared_ptr<topology_t>>& add_expr_topologies(
-		const std::shared_ptr<ast_node_t>& ast,
+		const ast_source_t& source,
+		std::map<std::string, std::shared_ptr<topology_t>>& topologies);
+static std::shared_ptr<topology_t> construct_expr_topology(
+		const ast_expr_t *expr,
 		std::map<std::string, std::shared_ptr<topology_t>>& topologies);
-static std::shared_ptr<topology_basic_t> construct_expr_topology(
-		std::shared_ptr<ast_expr_t>& expr,
-		std::map<std::string, std::shared_ptr<topology_t>>& topologies,
-		std::shared_ptr<topology_basic_t>& arg);
 
-static std::vector<pg_t> get_pgs(const std::shared_ptr<ast_node_t>& ast,
+static std::vector<pg_t> get_pgs(const ast_source_t& source,
 	const topology_basic_t& topology);
 
 static inline std::string remove_space(const std::string& s);
+static mapped_file_t open_policy_file(const char *file_path);
 
 static void topological_sort_dfs(
-		const std::vector<std::vector<uint8_t>>& m,
+		const bit_matrix_t& m,
 		const int index,
 		std::vector<bool>& discovered,
 		std::vector<int>& end_time,
 		int& time,
 		std::list<int>& topological_order);
-static std::list<int> topological_ordering(const std::vector<std::vector<uint8_t>>& m);
+static std::list<int> topological_ordering(const bit_matrix_t& m);
 
 
 policy_t::policy_t(const char *file_path) {
-	std::vector<symbol_t> symbols = lexify(file_path);
-
-	dertree_t tree = parse_source(symbols);
-	std::shared_ptr<ast_node_t> ast = ast_construct(tree, nullptr);
-
-	topologies = get_simple_topologies(ast);
-	topologies = add_expr_topologies(ast, topologies);
-
-	topology = std::make_shared<topology_basic_t>("Total");
+	/* the symbols and the names in the AST are views into the mapping, so
+	 * the file has to stay mapped for as long as the AST is used */
+	mapped_file_t file = open_policy_file(file_path);
+	std::vector<symbol_t> symbols = lexify(file.view());
+
+	// the whole AST is released with the arena at the end of the constructor
+	ast_arena_t arena;
+	parser_t parser(symbols, arena);
+	ast_source_t *source = parser.parse_source();
+
+	topologies = get_simple_topologies(*source);
+	topologies = add_expr_topologies(*source, topologies);
+
+	// the size is known before anything is materialized, unknown included
+	size_t n = 1;
+	std::vector<std::shared_ptr<topology_t>> parts;
+	parts.reserve(topologies.size());
+	for (auto& tuple : topologies) {
+		size_t size = tuple.second->size();
+		n = n > SIZE_MAX - size ? SIZE_MAX : n + size;
+		parts.push_back(tuple.second);
+	}
+	if (n > 256) {
+		std::ostringstream oss;
+		oss << "The policy is too big: " << n
+			<< " tags found, but there are only 256 available!";
+		throw std::runtime_error(oss.str());
+	}
+	topology = std::make_shared<topology_basic_t>("Total", parts);
 
+	/* check DAG, linear topologies and the expressions built from DAGs are
+	 * acyclic and nothing points back to unknown, so only the basic
+	 * topologies can contain a cycle */
 	for (auto& tuple : topologies) {
 		if (auto t = std::dynamic_pointer_cast<topology_basic_t>(tuple.second)) {
-			for (auto& m : t->index_mapping()) {
-				tags.insert(m.first);
-			}
-			topology->disjoint_union(topology, t);
-		}
-		if (auto t = std::dynamic_pointer_cast<topology_linear_t>(tuple.second)) {
-			for (auto &s : t->get_tags()) {
-				tags.insert(s);
-			}
-			auto converted = std::make_shared<topology_basic_t>(*t);
-			topology->disjoint_union(topology, converted);
+			topological_ordering(t->matrix());
 		}
 	}
 
-	tags.insert("unknown");
-	topology->add_unknown();
-
-	// check DAG
-	topological_ordering(topology->matrix());
-
-	perimeter_guards = get_pgs(ast, *topology);
+	perimeter_guards = get_pgs(*source, *topology);
 }
 
-static std::map<std::string, std::shared_ptr<topology_t>> get_simple_topologies(const std::shared_ptr<ast_node_t>& ast) {
+static std::map<std::string, std::shared_ptr<topology_t>> get_simple_topologies(const ast_source_t& source) {
 	std::map<std::string, std::shared_ptr<topology_t>> topologies;
-	if (auto source = std::dynamic_pointer_cast<ast_source_t>(ast)) {
-		for (auto& decl : source->get_decls()) {
-			if (auto t = std::dynamic_pointer_cast<ast_topology_basic_t>(decl)) {
-				if (topologies.find(t->get_name()) != topologies.end()) {
+	for (auto decl : source.get_decls()) {
+		switch (decl->get_kind()) {
+			case Node_kind::TOPOLOGY_BASIC: {
+				auto t = static_cast<const ast_topology_basic_t *>(decl);
+				std::string name(t->get_name());
+				if (topologies.find(name) != topologies.end()) {
 					std::ostringstream oss;
-					oss << "Topology '" << t->get_name() << "' cannot be declared twice!";
+					oss << "Topology '" << name << "' cannot be declared twice!";
 					throw std::runtime_error(oss.str());
 				}
 				std::set<std::string> vertices;
 				for (auto& edge : t->get_edges()) {
-					vertices.insert(edge->get_source()->get_name());
-					vertices.insert(edge->get_end()->get_name());
+					vertices.emplace(edge.source);
+					vertices.emplace(edge.end);
 				}
-				auto basic = std::make_shared<topology_basic_t>(t->get_name(), vertices);
+				auto basic = std::make_shared<topology_basic_t>(name, vertices);
 				for (auto& edge : t->get_edges()) {
-					basic->add_edge(edge->get_source()->get_name(), edge->get_end()->get_name());
+					basic->add_edge(std::string(edge.source), std::string(edge.end));
 				}
 
-				topologies[t->get_name()] = basic;
-			} else if(auto t = std::dynamic_pointer_cast<ast_topology_linear_t>(decl)) {
-				if (topologies.find(t->get_name()) != topologies.end()) {
+				topologies[name] = basic;
+				break;
+			}
+			case Node_kind::TOPOLOGY_LINEAR: {
+				auto t = static_cast<const ast_topology_linear_t *>(decl);
+				std::string name(t->get_name());
+				if (topologies.find(name) != topologies.end()) {
 					std::ostringstream oss;
-					oss << "Topology '" << t->get_name() << "' cannot be declared twice!";
+					oss << "Topology '" << name << "' cannot be declared twice!";
 					throw std::runtime_error(oss.str());
 				}
-				auto linear = std::make_shared<topology_linear_t>(t->get_name());
+				auto linear = std::make_shared<topology_linear_t>(name);
 				for (auto& tag : t->get_tags()) {
-					linear->add_tag(tag->get_name());
+					linear->add_tag(std::string(tag));
 				}
-				topologies[t->get_name()] = linear;
+				topologies[name] = linear;
+				break;
 			}
+			default:
+				break;
 		}
 	}
 	return topologies;
 }
 
 static std::map<std::string, std::shared_ptr<topology_t>>& add_expr_topologies(
-		const std::shared_ptr<ast_node_t>& ast,
+		const ast_source_t& source,
 		std::map<std::string, std::shared_ptr<topology_t>>& topologies) {
-	if (auto source = std::dynamic_pointer_cast<ast_source_t>(ast)) {
-		for (auto& decl : source->get_decls()) {
-			if (auto t = std::dynamic_pointer_cast<ast_topology_expr_t>(decl)) {
-				if (topologies.find(t->get_name()) != topologies.end()) {
-					std::ostringstream oss;
-					oss << "Topology '" << t->get_name() << "' cannot be declared twice!";
-					throw std::runtime_error(oss.str());
-				}
-				auto topology = std::make_shared<topology_basic_t>(t->get_name());
-				topology = construct_expr_topology(t->get_expr(), topologies, topology);
-				topology->set_name_prefix(t->get_name());
-				topologies[t->get_name()] = topology;
-			}
+	for (auto decl : source.get_decls()) {
+		if (decl->get_kind() != Node_kind::TOPOLOGY_EXPR) {
+			continue;
+		}
+		auto t = static_cast<const ast_topology_expr_t *>(decl);
+		std::string name(t->get_name());
+		if (topologies.find(name) != topologies.end()) {
+			std::ostringstream oss;
+			oss << "Topology '" << name << "' cannot be declared twice!";
+			throw std::runtime_error(oss.str());
 		}
+		auto expr = construct_expr_topology(t->get_expr(), topologies);
+		topologies[name] = std::make_shared<topology_expr_t>(name, expr);
 	}
 	return topologies;
 }
 
-static std::shared_ptr<topology_basic_t> construct_expr_topology(
-		std::shared_ptr<ast_expr_t>& expr,
-		std::map<std::string, std::shared_ptr<topology_t>>& topologies,
-		std::shared_ptr<topology_basic_t>& arg) {
-	if (auto e = std::dynamic_pointer_cast<ast_expr_bin_t>(expr)) {
-		auto lhs = construct_expr_topology(e->get_lhs(), topologies, arg);
-		auto rhs = construct_expr_topology(e->get_rhs(), topologies, arg);
-		switch (e->get_oper()) {
-			case ast_expr_bin_t::Oper::SUM: {
-				arg->disjoint_union(lhs, rhs);
-				return arg;
-			}
-			case ast_expr_bin_t::Oper::MUL: {
-				arg->carthesian_product(lhs, rhs);
-				return arg;
+// operands are shared with the referenced topologies, nothing is copied
+static std::shared_ptr<topology_t> construct_expr_topology(
+		const ast_expr_t *expr,
+		std::map<std::string, std::shared_ptr<topology_t>>& topologies) {
+	switch (expr->get_kind()) {
+		case Node_kind::EXPR_BIN: {
+			auto e = static_cast<const ast_expr_bin_t *>(expr);
+			auto lhs = construct_expr_topology(e->get_lhs(), topologies);
+			auto rhs = construct_expr_topology(e->get_rhs(), topologies);
+			switch (e->get_oper()) {
+				case ast_expr_bin_t::Oper::SUM:
+					return std::make_shared<topology_sum_t>(lhs, rhs);
+				case ast_expr_bin_t::Oper::MUL:
+					return std::make_shared<topology_product_t>(lhs, rhs);
+				default:
+					throw std::runtime_error("Unsupported binary operaion!");
 			}
-			default:
-				throw std::runtime_error("Unsupported binary operaion!");
 		}
-	} else if (auto e = std::dynamic_pointer_cast<ast_tag_t>(expr)) {
-		try {
-			std::shared_ptr<topology_t>& t = topologies.at(e->get_name());
-			if (auto tl = std::dynamic_pointer_cast<topology_linear_t>(t)) {
-				return std::make_shared<topology_basic_t>(*tl);
-			} else if (auto tb = std::dynamic_pointer_cast<topology_basic_t>(t)) {
-				return tb;
+		case Node_kind::TAG: {
+			auto e = static_cast<const ast_tag_t *>(expr);
+			auto search = topologies.find(std::string(e->get_name()));
+			if (search == topologies.end()) {
+				std::ostringstream oss;
+				oss << "Unknown topology: '" << e->get_name() << "'!";
+				throw std::runtime_error(oss.str());
 			}
-			std::ostringstream oss;
-			oss << "Topology '" << e->get_name() << "' should be linear or basic!";
-			throw std::runtime_error(oss.str());
-		} catch (std::out_of_range& err) {
-			std::ostringstream oss;
-			oss << "Unknown topology: '" << e->get_name() << "'!";
-			throw std::runtime_error(oss.str());
+			return search->second;
 		}
-	} else {
-		throw std::runtime_error("Unknown expression!");
+		default:
+			throw std::runtime_error("Unknown expression!");
 	}
 }
 
-static std::vector<pg_t> get_pgs(const std::shared_ptr<ast_node_t>& ast,
+static std::vector<pg_t> get_pgs(const ast_source_t& source,
 		const topology_basic_t& topology) {
 	std::vector<pg_t> perimeter_guards;
-	if (auto source = std::dynamic_pointer_cast<ast_source_t>(ast)) {
-		for (auto& decl : source->get_decls()) {
-			if (auto t = std::dynamic_pointer_cast<ast_pg_t>(decl)) {
-				try {
-					auto tag = topology.get_index(t->get_tag());
-					pg_t pg(t->get_name(), t->get_file(), tag);
-					perimeter_guards.push_back(pg);
-				} catch (std::out_of_range& e) {
-					std::ostringstream oss;
-					oss << "Unknown tag for perimeter guard '" << t->get_name()
-						<< "': '"<< t->get_tag() << "'!";
-					throw std::runtime_error(oss.str());
-				}
-			}
+	for (auto decl : source.get_decls()) {
+		if (decl->get_kind() != Node_kind::PG) {
+			continue;
+		}
+		auto t = static_cast<const ast_pg_t *>(decl);
+		try {
+			auto tag = topology.get_index(std::string(t->get_tag()));
+			pg_t pg(std::string(t->get_name()), std::string(t->get_file()), tag);
+			perimeter_guards.push_back(pg);
+		} catch (std::out_of_range& e) {
+			std::ostringstream oss;
+			oss << "Unknown tag for perimeter guard '" << t->get_name()
+				<< "': '"<< t->get_tag() << "'!";
+			throw std::runtime_error(oss.str());
 		}
 	}
 	return perimeter_guards;
 }
 
-topology_basic_t::topology_basic_t(const std::string& n) {
-	name = n;
-	mvertices = std::vector<std::vector<uint8_t>>();
-	toindex = std::map<std::string, int>();
-	fromindex = std::map<int, std::string>();
-}
-
 topology_basic_t::topology_basic_t(
 		const std::string& n,
 		const std::set<std::string>& vertices) {
 	name = n;
-	mvertices = std::vector<std::vector<uint8_t>>(
-		vertices.size(), std::vector<uint8_t>(vertices.size()));
-	toindex = std::map<std::string, int>();
-	fromindex = std::map<int, std::string>();
-	int i = 0;
+	mvertices = bit_matrix_t(vertices.size());
+	toindex.reserve(vertices.size());
+	fromindex.reserve(vertices.size());
 	for (auto& v : vertices) {
-		toindex[fullname(v)] = i;
-		fromindex[i] = fullname(v);
-		mvertices[i][i] = 1;
-		i++;
+		mvertices.set(fromindex.size(), fromindex.size());
+		add_tag(fullname(v));
 	}
 }
 
-topology_basic_t::topology_basic_t(topology_linear_t& t) {
-	name = t.get_name();
-	size_t n = t.get_tags().size();
-	mvertices = std::vector<std::vector<uint8_t>>(n, std::vector<uint8_t>(n));
-	for (size_t i = 0; i < n; i++) {
-		mvertices[i][i] = 1;
-		if (i + 1 < mvertices.size()) {
-			mvertices[i][i + 1] = 1;
+/* Every part is written at its offset, unknown takes index 0 and is below
+ * every other tag. */
+topology_basic_t::topology_basic_t(
+		const std::string& n,
+		const std::vector<std::shared_ptr<topology_t>>& parts) {
+	name = n;
+	size_t size = 1;
+	for (auto& t : parts) {
+		size += t->size();
+	}
+	mvertices = bit_matrix_t(size);
+	toindex.reserve(size);
+	fromindex.reserve(size);
+
+	mvertices.fill_row(0);
+	add_tag("unknown");
+	for (auto& t : parts) {
+		size_t offset = fromindex.size();
+		t->write_adjacency(mvertices, offset);
+		for (size_t i = 0; i < t->size(); i++) {
+			std::string tag = t->get_tag(i);
+			if (toindex.find(tag) != toindex.end()) {
+				std::ostringstream oss;
+				oss << "Tag '" << tag << "' appears twice in topology '" << t->get_name() << "'!";
+				throw std::runtime_error(oss.str());
+			}
+			add_tag(std::move(tag));
 		}
-		std::string tag = remove_space(t.get_tags().at(i));
-		toindex[tag] = i;
-		fromindex[i] = tag;
 	}
 }
 
+void topology_basic_t::add_tag(std::string tag) {
+	toindex.emplace(tag, fromindex.size());
+	fromindex.push_back(std::move(tag));
+}
+
 void topology_basic_t::add_edge(
 		const std::string& source,
 		const std::string& end) {
 	int i = toindex.at(fullname(source));
 	int j = toindex.at(fullname(end));
-	mvertices[i][j] = 1;
+	mvertices.set(i, j);
 }
 
 void topology_basic_t::print() {
 	std::cout << "Topology: '" << name << "'" << std::endl;
-	for (auto& kv : toindex) {
-		std::cout << "\t'" << kv.first << "', " <<  kv.second << ":";
+	for (size_t i = 0; i < fromindex.size(); i++) {
+		std::cout << "\t'" << fromindex[i] << "', " <<  i << ":";
 		for (size_t j = 0; j < mvertices.size(); j++) {
-			std::cout << " " << (int) mvertices[kv.second][j];
+			std::cout << " " << (int) mvertices.test(i, j);
 		}
 		std::cout << std::endl;
 	}
 }
 
-void topology_basic_t::carthesian_product(
-		const std::shared_ptr<topology_basic_t>& t1,
-		const std::shared_ptr<topology_basic_t>& t2) {
-	size_t n = t1->size();
-	size_t m = t2->size();
-	auto& a = t1->matrix();
-	auto& b = t2->matrix();
-	auto& mapping_a = t1->index_mapping();
-	auto& mapping_b = t2->index_mapping();
-
-	std::map<std::string, int> r_toindex;
-	std::map<int, std::string> r_fromindex;
-	for (auto& tuple_a : mapping_a) {
-		for (auto& tuple_b : mapping_b) {
-			std::string name = "(" +  tuple_a.first + "," + tuple_b.first + ")";
-			int index = tuple_a.second * m + tuple_b.second;
-			std::string tag = remove_space(name);
-			r_toindex[tag] = index;
-			r_fromindex[index] = tag;
-		}
-	}
-	toindex.clear();
-	toindex = r_toindex;
-	fromindex.clear();
-	fromindex = r_fromindex;
+std::string topology_t::fullname(const std::string& tag) {
+	return remove_space(name + "." + tag);
+}
+
+static inline std::string remove_space(const std::string& s) {
+	std::string r = s;
+	r.erase(std::remove_if(r.begin(), r.end(), isspace), r.end());
+	return r;
+}
 
-	std::vector<std::vector<uint8_t>> r(n * m, std::vector<uint8_t>(n * m));
+int policy_t::tag_index(const std::string& tag) const {
+	return topology->get_index(tag);
+}
 
-	/* Do R = A (x) I_2 */
-	for (size_t i = 0; i < n; i++) {
-		for (size_t j = 0; j < n; j++) {
-			for (size_t ri = 0; ri < m; ri++) {
-				r[i * m + ri][j * m + ri] = a[i][j];
-			}
-		}
-	}
+int topology_basic_t::get_index(const std::string& tag) const {
+	return toindex.at(remove_space(tag));
+}
 
-	/* Do R += I_1 (x) B */
-	for (size_t ri = 0; ri < m * n; ri += m) {
-		for (size_t i = 0; i < m; i++) {
-			for (size_t j = 0; j < m; j++) {
-				r[ri + i][ri + j] |= b[i][j];
-			}
-		}
-	}
+std::string topology_basic_t::get_tag(int index) const {
+	return fromindex.at(index);
+}
 
-	for (size_t i = 0; i < mvertices.size(); i++) {
-		mvertices[i].clear();
+const std::vector<std::vector<uint8_t>>& topology_t::lca() const {
+	if (!lca_built) {
+		lca_table = build_lca();
+		lca_built = true;
 	}
-	mvertices.clear();
-	mvertices = r;
-}
-
-void topology_basic_t::disjoint_union(
-		const std::shared_ptr<topology_basic_t>& t1,
-		const std::shared_ptr<topology_basic_t>& t2) {
-	size_t n = t1->size();
-	size_t m = t2->size();
-	auto& a = t1->matrix();
-	auto& b = t2->matrix();
-	auto& mapping_a = t1->index_mapping();
-	auto& mapping_b = t2->index_mapping();
-
-	std::map<std::string, int> r_toindex;
-	std::map<int, std::string> r_fromindex;
-	for (auto& tuple : mapping_a) {
-		std::string tag = remove_space(tuple.first);
-		r_toindex[tag] = tuple.second;
-		r_fromindex[tuple.second] = tag;
-	}
-	for (auto& tuple : mapping_b) {
-		std::string tag = remove_space(tuple.first);
-		r_toindex[tag] = n + tuple.second;
-		r_fromindex[n + tuple.second] = tag;
+	return lca_table;
+}
+
+int topology_t::get_index(const std::string& tag) const {
+	int index = find_index(remove_space(tag));
+	if (index < 0) {
+		std::ostringstream oss;
+		oss << "Tag '" << tag << "' not in the topology!";
+		throw std::out_of_range(oss.str());
 	}
-	toindex.clear();
-	toindex = r_toindex;
-	fromindex.clear();
-	fromindex = r_fromindex;
+	return index;
+}
 
-	std::vector<std::vector<uint8_t>> r(n + m, std::vector<uint8_t>(n + m));
+int topology_basic_t::find_index(const std::string& tag) const {
+	auto search = toindex.find(tag);
+	return search == toindex.end() ? -1 : search->second;
+}
 
-	/* Perform direct sum of matrices */
-	for (size_t i = 0; i < n; i++) {
-		for (size_t j = 0; j < n; j++) {
-			r[i][j] = a[i][j];
+void topology_basic_t::write_adjacency(bit_matrix_t& m, const size_t offset) const {
+	m.or_block(offset, mvertices);
+}
+
+int topology_linear_t::find_index(const std::string& tag) const {
+	for (size_t i = 0; i < tags.size(); i++) {
+		if (tags[i] == tag) {
+			return i;
 		}
 	}
+	return -1;
+}
 
-	for (size_t i = 0; i < m; i++) {
-		for (size_t j = 0; j < m; j++) {
-			r[n + i][n + j] = b[i][j];
+void topology_linear_t::write_adjacency(bit_matrix_t& m, const size_t offset) const {
+	for (size_t i = 0; i < tags.size(); i++) {
+		m.set(offset + i, offset + i);
+		if (i + 1 < tags.size()) {
+			m.set(offset + i, offset + i + 1);
 		}
 	}
+}
 
-	for (size_t i = 0; i < mvertices.size(); i++) {
-		mvertices[i].clear();
-	}
-	mvertices.clear();
-	mvertices = r;
+std::string topology_sum_t::get_tag(int index) const {
+	int n = lhs->size();
+	return index < n ? lhs->get_tag(index) : rhs->get_tag(index - n);
 }
 
-void topology_basic_t::set_name_prefix(const std::string& prefix) {
-	std::map<std::string, int> updated_to;
-	std::map<int, std::string> updated_from;
-	for (auto& t : toindex) {
-		std::string r = remove_space(prefix + "." + t.first);
-		updated_to[r] = t.second;
-		updated_from[t.second] = r;
+int topology_sum_t::find_index(const std::string& tag) const {
+	int index = lhs->find_index(tag);
+	if (index >= 0) {
+		return index;
 	}
-	toindex.clear();
-	toindex = updated_to;
-	fromindex.clear();
-	fromindex = updated_from;
+	index = rhs->find_index(tag);
+	return index < 0 ? -1 : lhs->size() + index;
 }
 
-std::string topology_t::fullname(const std::string& tag) {
-	return remove_space(name + "." + tag);
+void topology_sum_t::write_adjacency(bit_matrix_t& m, const size_t offset) const {
+	lhs->write_adjacency(m, offset);
+	rhs->write_adjacency(m, offset + lhs->size());
 }
 
-bool policy_t::contains_tag(const std::string& tag) const {
-	std::string cleaned = remove_space(tag);
-	return tags.find(cleaned) != tags.end();
+std::string topology_product_t::get_tag(int index) const {
+	int m = rhs->size();
+	return "(" + lhs->get_tag(index / m) + "," + rhs->get_tag(index % m) + ")";
 }
 
-static inline std::string remove_space(const std::string& s) {
-	std::string r = s;
-	r.erase(std::remove_if(r.begin(), r.end(), isspace), r.end());
-	return r;
+int topology_product_t::find_index(const std::string& tag) const {
+	if (tag.size() < 2 || tag.front() != '(' || tag.back() != ')') {
+		return -1;
+	}
+	// tags may contain commas themselves, so every split is tried
+	for (size_t k = tag.find(',', 1); k < tag.size() - 1; k = tag.find(',', k + 1)) {
+		int a = lhs->find_index(tag.substr(1, k - 1));
+		if (a < 0) {
+			continue;
+		}
+		int b = rhs->find_index(tag.substr(k + 1, tag.size() - k - 2));
+		if (b >= 0) {
+			return a * rhs->size() + b;
+		}
+	}
+	return -1;
 }
 
-int policy_t::tag_index(const std::string& tag) const {
-	return topology->get_index(tag);
-}
+/* R = A (x) I_m + I_n (x) B */
+void topology_product_t::write_adjacency(bit_matrix_t& r, const size_t offset) const {
+	size_t n = lhs->size();
+	size_t m = rhs->size();
+	bit_matrix_t a(n);
+	bit_matrix_t b(m);
+	lhs->write_adjacency(a, 0);
+	rhs->write_adjacency(b, 0);
 
-int topology_basic_t::get_index(const std::string& tag) const {
-	return toindex.at(remove_space(tag));
+	for (size_t i = 0; i < n; i++) {
+		for (size_t ri = 0; ri < m; ri++) {
+			size_t row = offset + i * m + ri;
+			for (size_t j = a.next(i, 0); j < n; j = a.next(i, j + 1)) {
+				r.set(row, offset + j * m + ri);
+			}
+			r.or_bits(row, offset + i * m, b.row(ri), m);
+		}
+	}
 }
 
-std::string topology_basic_t::get_tag(int index) const {
-	return fromindex.at(index);
+std::string topology_expr_t::get_tag(int index) const {
+	return name + "." + expr->get_tag(index);
 }
 
-int topology_linear_t::get_index(const std::string& tag) const {
-	std::string cleaned = remove_space(tag);
-	for (size_t i = 0; i < tags.size(); i++) {
-		if (tags[i] == cleaned) {
-			return i;
-		}
+int topology_expr_t::find_index(const std::string& tag) const {
+	if (tag.size() <= name.size() || tag.compare(0, name.size(), name) != 0 || tag[name.size()] != '.') {
+		return -1;
 	}
-	std::ostringstream oss;
-	oss << "Tag '" << tag << "' not in the topology!";
-	throw std::runtime_error(oss.str());
+	return expr->find_index(tag.substr(name.size() + 1));
 }
 
-void topology_basic_t::add_unknown() {
-	auto new_toindex = std::map<std::string, int>();
-	auto new_fromindex = std::map<int, std::string>();
-	for (auto& t : toindex) {
-		new_toindex[t.first] = t.second + 1;
-		new_fromindex[t.second + 1] = t.first;
+/* The LCA table is assembled from the tables of the declared topologies,
+ * the tags of different topologies only meet in unknown, which is below
+ * every tag. */
+void policy_t::compute_lca() {
+	size_t n = topology->size();
+	lca_matrix.assign(n, std::vector<uint8_t>(n, TAG_INVALID));
+	size_t offset = 1;
+	for (auto& tuple : topologies) {
+		lca_place(lca_matrix, offset, tuple.second->lca());
+		offset += tuple.second->size();
 	}
-	new_toindex["unknown"] = 0;
-	new_fromindex[0] = "unknown";
-	toindex.clear();
-	toindex = new_toindex;
-	fromindex.clear();
-	fromindex = new_fromindex;
-
-	for (auto& row : mvertices) {
-		row.emplace(row.begin(), 0);
+	for (size_t i = 0; i < n; i++) {
+		lca_matrix[0][i] = i;
+		lca_matrix[i][0] = i;
 	}
-	auto unknowns = std::vector<uint8_t>(mvertices.size() + 1, 1);
-	mvertices.emplace(mvertices.begin(), unknowns);
 }
 
 void policy_t::dump(std::ofstream& out) {
@@ -444,16 +444,26 @@ void policy_t::dump(std::ofstream& out) {
 
 
 
+static mapped_file_t open_policy_file(const char *file_path) {
+	try {
+		return mapped_file_t(file_path);
+	} catch (std::exception& e) {
+		std::ostringstream oss;
+		oss << "Couldn't open policy file: '" << file_path << "'!";
+		throw std::invalid_argument(oss.str());
+	}
+}
+
 static void topological_sort_dfs(
-		const std::vector<std::vector<uint8_t>>& m,
+		const bit_matrix_t& m,
 		const int index,
 		std::vector<bool>& discovered,
 		std::vector<int>& end_time,
 		int& time,
 		std::list<int>& topological_order) {
 	discovered[index] = true;
-	for (size_t j = 0; j < m[index].size(); j++) {
-		if (m[index][j] > 0 && !discovered[j]) {
+	for (size_t j = m.next(index, 0); j < m.size(); j = m.next(index, j + 1)) {
+		if (!discovered[j]) {
 			topological_sort_dfs(m, j, discovered, end_time, time, topological_order);
 		}
 	}
@@ -462,7 +472,7 @@ static void topological_sort_dfs(
 	time++;
 }
 
-static std::list<int> topological_ordering(const std::vector<std::vector<uint8_t>>& m) {
+static std::list<int> topological_ordering(const bit_matrix_t& m) {
 	std::vector<bool> discovered(m.size());
 	std::vector<int> end_time(m.size());
 	int time = 0;
@@ -475,8 +485,8 @@ static std::list<int> topological_ordering(const std::vector<std::vector<uint8_t
 	}
 
 	for (size_t i = 0; i < m.size(); i++) {
-		for (size_t j = 0; j < m.size(); j++) {
-			if (i != j && m[i][j] > 0 && end_time[i] <= end_time[j]) {
+		for (size_t j = m.next(i, 0); j < m.size(); j = m.next(i, j + 1)) {
+			if (i != j && end_time[i] <= end_time[j]) {
 				std::ostringstream oss;
 				oss << "The policy is not a directed acyclical graph!";// <<
 				throw std::runtime_error(oss.str());
@@ -4,9 +4,14 @@
 #include <string>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <iostream>
 #include <memory>
+#include <cstdint>
+
+#include "bit_matrix.h"
+#include "lca.h"
 
 
 class topology_t {
@@ -15,13 +20,30 @@ class topology_t {
 		std::string& get_name() {
 			return name;
 		}
+		const std::string& get_name() const {
+			return name;
+		}
 		virtual void print() {
 			std::cout << name << std::endl;
 		}
 		virtual std::string fullname(const std::string& tag);
-		virtual int get_index(const std::string& tag) const = 0;
+		virtual size_t size() const = 0;
+		virtual std::string get_tag(int index) const = 0;
+		// index of the tag or -1 if the topology doesn't contain it
+		virtual int find_index(const std::string& tag) const = 0;
+		virtual int get_index(const std::string& tag) const;
+		// ORs the adjacency matrix into m with its top left corner at (offset, offset)
+		virtual void write_adjacency(bit_matrix_t& m, const size_t offset) const = 0;
+		/* LCA table in the indexes of the topology, built on the first call.
+		 * Topologies referenced by several expressions share it. */
+		const std::vector<std::vector<uint8_t>>& lca() const;
 	protected:
+		virtual std::vector<std::vector<uint8_t>> build_lca() const = 0;
+
 		std::string name;
+	private:
+		mutable std::vector<std::vector<uint8_t>> lca_table;
+		mutable bool lca_built = false;
 };
 
 
@@ -36,8 +58,7 @@ class topology_linear_t : public topology_t {
 			name = n;
 		}
 		void add_tag(const std::string& tag) {
-			std::string fullname = name + "." + tag;
-			tags.push_back(fullname);
+			tags.push_back(fullname(tag));
 		}
 
 		std::vector<std::string>& get_tags() {
@@ -53,41 +74,127 @@ class topology_linear_t : public topology_t {
 			std::cout << std::endl;
 		}
 
-		int get_index(const std::string& tag) const;
+		size_t size() const {
+			return tags.size();
+		}
+		std::string get_tag(int index) const {
+			return tags.at(index);
+		}
+		int find_index(const std::string& tag) const;
+		void write_adjacency(bit_matrix_t& m, const size_t offset) const;
+	protected:
+		std::vector<std::vector<uint8_t>> build_lca() const {
+			return lca_chain(tags.size());
+		}
 	private:
 		std::vector<std::string> tags;
 };
 
 class topology_basic_t : public topology_t {
 	public:
-		topology_basic_t(const std::string& n);
 		topology_basic_t(const std::string& n, const std::set<std::string>& vertices);
-		topology_basic_t(topology_linear_t& t);
+		// unknown followed by the disjoint union of the parts
+		topology_basic_t(const std::string& n, const std::vector<std::shared_ptr<topology_t>>& parts);
 		void add_edge(const std::string& source, const std::string& end);
 		size_t size() const {
 			return mvertices.size();
 		}
-		const std::vector<std::vector<uint8_t>>& matrix() const {
+		const bit_matrix_t& matrix() const {
 			return mvertices;
 		}
-		std::map<std::string, int>& index_mapping() {
-			return toindex;
-		}
-		void disjoint_union(
-			const std::shared_ptr<topology_basic_t>& t1,
-			const std::shared_ptr<topology_basic_t>& t2);
-		void carthesian_product(
-			const std::shared_ptr<topology_basic_t>& t1,
-			const std::shared_ptr<topology_basic_t>& t2);
 		void print();
-		void set_name_prefix(const std::string& prefix);
+		int find_index(const std::string& tag) const;
 		int get_index(const std::string& tag) const;
 		std::string get_tag(int index) const;
-		void add_unknown();
+		void write_adjacency(bit_matrix_t& m, const size_t offset) const;
+	protected:
+		std::vector<std::vector<uint8_t>> build_lca() const {
+			return compute_component_lca(mvertices);
+		}
+	private:
+		void add_tag(std::string tag);
+
+		bit_matrix_t mvertices;
+		std::unordered_map<std::string, int> toindex;
+		std::vector<std::string> fromindex;
+};
+
+/* Disjoint union of two topologies. Nothing is copied, tags and edges are
+ * derived from the operands: the tags of lhs come first, followed by the
+ * tags of rhs. */
+class topology_sum_t : public topology_t {
+	public:
+		topology_sum_t(const std::shared_ptr<topology_t>& l, const std::shared_ptr<topology_t>& r) :
+				lhs(l), rhs(r) {
+			name = "(" + l->get_name() + " + " + r->get_name() + ")";
+		}
+		// saturates instead of wrapping around, so oversized policies are caught
+		size_t size() const {
+			size_t a = lhs->size();
+			size_t b = rhs->size();
+			return a > SIZE_MAX - b ? SIZE_MAX : a + b;
+		}
+		std::string get_tag(int index) const;
+		int find_index(const std::string& tag) const;
+		void write_adjacency(bit_matrix_t& m, const size_t offset) const;
+	protected:
+		std::vector<std::vector<uint8_t>> build_lca() const {
+			return lca_sum(lhs->lca(), rhs->lca());
+		}
+	private:
+		std::shared_ptr<topology_t> lhs;
+		std::shared_ptr<topology_t> rhs;
+};
+
+/* Cartesian product of two topologies. Tag (a,b) has the index
+ * index(a) * rhs->size() + index(b), an edge exists where one of the
+ * components has an edge and the other one stays the same. */
+class topology_product_t : public topology_t {
+	public:
+		topology_product_t(const std::shared_ptr<topology_t>& l, const std::shared_ptr<topology_t>& r) :
+				lhs(l), rhs(r) {
+			name = "(" + l->get_name() + " * " + r->get_name() + ")";
+		}
+		// saturates instead of wrapping around, so oversized policies are caught
+		size_t size() const {
+			size_t a = lhs->size();
+			size_t b = rhs->size();
+			return a != 0 && b > SIZE_MAX / a ? SIZE_MAX : a * b;
+		}
+		std::string get_tag(int index) const;
+		int find_index(const std::string& tag) const;
+		void write_adjacency(bit_matrix_t& m, const size_t offset) const;
+	protected:
+		std::vector<std::vector<uint8_t>> build_lca() const {
+			return lca_product(lhs->lca(), rhs->lca());
+		}
+	private:
+		std::shared_ptr<topology_t> lhs;
+		std::shared_ptr<topology_t> rhs;
+};
+
+/* Named expression topology, prefixes the tags of the expression with the
+ * topology name. */
+class topology_expr_t : public topology_t {
+	public:
+		topology_expr_t(const std::string& n, const std::shared_ptr<topology_t>& e) :
+				expr(e) {
+			name = n;
+		}
+		size_t size() const {
+			return expr->size();
+		}
+		std::string get_tag(int index) const;
+		int find_index(const std::string& tag) const;
+		void write_adjacency(bit_matrix_t& m, const size_t offset) const {
+			expr->write_adjacency(m, offset);
+		}
+	protected:
+		std::vector<std::vector<uint8_t>> build_lca() const {
+			return expr->lca();
+		}
 	private:
-		std::vector<std::vector<uint8_t>> mvertices;
-		std::map<std::string, int> toindex;
-		std::map<int, std::string> fromindex;
+		std::shared_ptr<topology_t> expr;
 };
 
 struct pg_t {
@@ -102,8 +209,8 @@ class policy_t {
 	public:
 		policy_t() {}
 		policy_t(const char *file_path);
-		bool contains_tag(const std::string& tag) const;
 		int tag_index(const std::string& tag) const;
+		void compute_lca();
 
 		void set_lca_matrix(const std::vector<std::vector<uint8_t>> lca) {
 			lca_matrix = lca;
@@ -118,7 +225,6 @@ class policy_t {
 		std::shared_ptr<topology_basic_t> topology;
 	private:
 		std::map<std::string, std::shared_ptr<topology_t>> topologies;
-		std::set<std::string> tags;
 		std::vector<std::vector<uint8_t>> lca_matrix;
 		std::vector<pg_t> perimeter_guards;
 };
@@ -6,341 +6,267 @@
 #include <exception>
 
 
-static dertree_t parse_decls(std::vector<symbol_t>& symbols);
-static dertree_t parse_decl(std::vector<symbol_t>& symbols);
-static dertree_t parse_declrest(std::vector<symbol_t>& symbols);
-static dertree_t parse_topology(std::vector<symbol_t>& symbols);
-static dertree_t parse_topology_rest(std::vector<symbol_t>& symbols);
-static dertree_t parse_basic(std::vector<symbol_t>& symbols);
-static dertree_t parse_edge(std::vector<symbol_t>& symbols);
-static dertree_t parse_edge_rest(std::vector<symbol_t>& symbols);
-static dertree_t parse_linear(std::vector<symbol_t>& symbols);
-static dertree_t parse_linear_rest(std::vector<symbol_t>& symbols);
-static dertree_t parse_expr(std::vector<symbol_t>& symbols);
-static dertree_t parse_sum(std::vector<symbol_t>& symbols);
-static dertree_t parse_sum_rest(std::vector<symbol_t>& symbols);
-static dertree_t parse_mul(std::vector<symbol_t>& symbols);
-static dertree_t parse_mul_rest(std::vector<symbol_t>& symbols);
-static dertree_t parse_elem(std::vector<symbol_t>& symbols);
-static dertree_t parse_pg(std::vector<symbol_t>& symbols);
-static dertree_t parse_pg_rest(std::vector<symbol_t>& symbols);
-
 static inline std::string error_msg(const symbol_t &s, const std::string expected);
 
-static inline symbol_t& peek(std::vector<symbol_t>& symbols, const std::string err);
-static inline symbol_t& consume(std::vector<symbol_t>& symbols, const std::string err);
-
-static void add_leaf(dertree_t& t, std::vector<symbol_t>& symbols,
-	Term expected_symbol, const std::string& err);
-
+// limits the recursion of nested parentheses in expressions
+static const int max_expr_depth = 256;
 
-size_t symbol_index = 0;
 
+parser_t::parser_t(const std::vector<symbol_t>& symbols, ast_arena_t& arena) :
+		symbols(symbols), symbol_index(0), arena(arena) {}
 
-dertree_t parse_source(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::SOURCE;
-	peek(symbols, "Policy file is empty!");
-	t.subtrees.push_back(parse_decls(symbols));
-	return t;
-}
-
-static dertree_t parse_decls(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::DECLS;
-	t.subtrees.push_back(parse_decl(symbols));
-	t.subtrees.push_back(parse_declrest(symbols));
-	return t;
+ast_source_t *parser_t::parse_source() {
+	auto source = arena.make<ast_source_t>();
+	peek("Policy file is empty!");
+	source->add_decl(parse_decl());
+	parse_declrest(*source);
+	return source;
 }
 
-static dertree_t parse_decl(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::DECL;
-	auto& s = peek(symbols, "Missing declarations!");
+ast_decl_t *parser_t::parse_decl() {
+	auto& s = peek("Missing declarations!");
 	switch (s.term) {
 		case Term::TOPOLOGY:
-			t.subtrees.push_back(parse_topology(symbols));
-			break;
+			return parse_topology();
 		case Term::PG:
-			t.subtrees.push_back(parse_pg(symbols));
-			break;
+			return parse_pg();
 		default:
 			throw std::runtime_error(error_msg(s, "declarations"));
 	}
-	return t;
 }
 
-static dertree_t parse_declrest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::DECLREST;
-	auto& s = peek(symbols, "Missing declarations!");
-	switch (s.term) {
-		case Term::END:
-			break;
-		case Term::TOPOLOGY:
-		case Term::PG:
-			t.subtrees.push_back(parse_decl(symbols));
-			t.subtrees.push_back(parse_declrest(symbols));
-			break;
-		default:
-			throw std::runtime_error(error_msg(s, "declarations"));
+void parser_t::parse_declrest(ast_source_t& source) {
+	while (true) {
+		auto& s = peek("Missing declarations!");
+		switch (s.term) {
+			case Term::END:
+				return;
+			case Term::TOPOLOGY:
+			case Term::PG:
+				source.add_decl(parse_decl());
+				break;
+			default:
+				throw std::runtime_error(error_msg(s, "declarations"));
+		}
 	}
-	return t;
 }
 
-static dertree_t parse_topology(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::TOPOLOGY;
+ast_topology_t *parser_t::parse_topology() {
+	expect(Term::TOPOLOGY, "'topology'");
+	auto& name = expect(Term::IDENTIFIER, "an identifier");
+	expect(Term::COLON, "':'");
 
-	add_leaf(t, symbols, Term::TOPOLOGY, "'topology'");
-	add_leaf(t, symbols, Term::IDENTIFIER, "an identifier");
-	add_leaf(t, symbols, Term::COLON, "':'");
-	t.subtrees.push_back(parse_topology_rest(symbols));
-
-	return t;
+	auto topology = parse_topology_rest();
+	topology->set_name(name.name);
+	return topology;
 }
 
-static dertree_t parse_topology_rest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::TOPOLOGYREST;
-
-	auto& s = consume(symbols, "Missing topology type!");
-	t.leaves.push_back(s);
+ast_topology_t *parser_t::parse_topology_rest() {
+	auto& s = consume("Missing topology type!");
 
 	switch (s.term) {
-		case Term::BASIC:
-			add_leaf(t, symbols, Term::LBRACE, "'{'");
-			t.subtrees.push_back(parse_basic(symbols));
-			add_leaf(t, symbols, Term::RBRACE, "'}");
-			break;
-		case Term::LINEAR:
-			t.subtrees.push_back(parse_linear(symbols));
-			break;
+		case Term::BASIC: {
+			auto basic = arena.make<ast_topology_basic_t>();
+			expect(Term::LBRACE, "'{'");
+			parse_basic(*basic);
+			expect(Term::RBRACE, "'}");
+			return basic;
+		}
+		case Term::LINEAR: {
+			auto linear = arena.make<ast_topology_linear_t>();
+			parse_linear(*linear);
+			return linear;
+		}
 		case Term::EXPR:
-			t.subtrees.push_back(parse_expr(symbols));
-			break;
+			return parse_expr();
 		default:
 			std::ostringstream oss;
 			oss << "Unsupported topology type '" << s.name << "'! Location: "
 				<< s.line << ", " << s.column;
 			throw std::runtime_error(oss.str());
 	}
-
-	return t;
 }
 
-static dertree_t parse_basic(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::BASIC;
-	t.subtrees.push_back(parse_edge(symbols));
-	t.subtrees.push_back(parse_edge_rest(symbols));
-	return t;
+void parser_t::parse_basic(ast_topology_basic_t& basic) {
+	ast_edge_t edge = parse_edge();
+	basic.add_edge(edge.source, edge.end);
+	parse_edge_rest(basic);
 }
 
 
-static dertree_t parse_edge(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::EDGE;
+ast_edge_t parser_t::parse_edge() {
+	auto& source = expect(Term::STRING, "a tag string");
+	expect(Term::ARROW, "'->'");
+	auto& end = expect(Term::STRING, "a tag string");
 
-	add_leaf(t, symbols, Term::STRING, "a tag string");
-	add_leaf(t, symbols, Term::ARROW, "'->'");
-	add_leaf(t, symbols, Term::STRING, "a tag string");
-
-	return t;
+	return { source.name, end.name };
 }
 
-static dertree_t parse_edge_rest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::EDGEREST;
-
-	auto& s = peek(symbols, "Missing a ',' or '}'!");
-	switch (s.term) {
-		case Term::RBRACE:
-			break;
-		case Term::COMMA:
-			t.leaves.push_back(s);
-			consume(symbols, "Missing a ','!");
-			t.subtrees.push_back(parse_edge(symbols));
-			t.subtrees.push_back(parse_edge_rest(symbols));
-			break;
-		default:
-			throw std::runtime_error(error_msg(s, "',' or '}'"));
+void parser_t::parse_edge_rest(ast_topology_basic_t& basic) {
+	while (true) {
+		auto& s = peek("Missing a ',' or '}'!");
+		switch (s.term) {
+			case Term::RBRACE:
+				return;
+			case Term::COMMA: {
+				consume("Missing a ','!");
+				ast_edge_t edge = parse_edge();
+				basic.add_edge(edge.source, edge.end);
+				break;
+			}
+			default:
+				throw std::runtime_error(error_msg(s, "',' or '}'"));
+		}
 	}
-	return t;
 }
 
-static dertree_t parse_linear(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::LINEAR;
-
-	add_leaf(t, symbols, Term::STRING, "a tag string");
-	t.subtrees.push_back(parse_linear_rest(symbols));
-	return t;
+void parser_t::parse_linear(ast_topology_linear_t& linear) {
+	auto& tag = expect(Term::STRING, "a tag string");
+	linear.add_tag(tag.name);
+	parse_linear_rest(linear);
 }
 
-static dertree_t parse_linear_rest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::LINEARREST;
-	auto& s = peek(symbols, "Missing a ',' or declarations!");
-	switch (s.term) {
-		case Term::TOPOLOGY:
-		case Term::END:
-		case Term::PG:
-			break;
-		case Term::COMMA:
-			t.leaves.push_back(s);
-			consume(symbols, "Missing a ','!");
-			t.subtrees.push_back(parse_linear(symbols));
-			break;
-		default:
-			throw std::runtime_error(error_msg(s, ","));
+void parser_t::parse_linear_rest(ast_topology_linear_t& linear) {
+	while (true) {
+		auto& s = peek("Missing a ',' or declarations!");
+		switch (s.term) {
+			case Term::TOPOLOGY:
+			case Term::END:
+			case Term::PG:
+				return;
+			case Term::COMMA: {
+				consume("Missing a ','!");
+				auto& tag = expect(Term::STRING, "a tag string");
+				linear.add_tag(tag.name);
+				break;
+			}
+			default:
+				throw std::runtime_error(error_msg(s, ","));
+		}
 	}
-
-	return t;
 }
 
-static dertree_t parse_expr(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::EXPR;
-	auto& s = peek(symbols, "Missing an identifier or expression!");
+ast_topology_t *parser_t::parse_expr() {
+	auto& s = peek("Missing an identifier or expression!");
 	switch (s.term) {
 		case Term::IDENTIFIER:
 		case Term::LPAREN:
-			t.subtrees.push_back(parse_sum(symbols));
-			break;
+			return arena.make<ast_topology_expr_t>(parse_sum(0));
 		default:
 			throw std::runtime_error(error_msg(s, "an identifier or '('"));
 	}
-
-	return t;
 }
 
-static dertree_t parse_sum(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::SUM;
-	auto& s = peek(symbols, "Missing identifier or expression!");
+ast_expr_t *parser_t::parse_sum(int depth) {
+	auto& s = peek("Missing identifier or expression!");
 	switch (s.term) {
 		case Term::IDENTIFIER:
 		case Term::LPAREN:
-			t.subtrees.push_back(parse_mul(symbols));
-			t.subtrees.push_back(parse_sum_rest(symbols));
-			break;
+			return parse_sum_rest(parse_mul(depth), depth);
 		default:
 			throw std::runtime_error(error_msg(s, "an identifier or '('"));
 	}
-
-	return t;
 }
 
-static dertree_t parse_sum_rest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::SUMREST;
-	auto& s = peek(symbols, "Missing end of expression or '+'!");
-	switch (s.term) {
-		case Term::TOPOLOGY:
-		case Term::RPAREN:
-		case Term::END:
-		case Term::PG:
-			break;
-		case Term::PLUS:
-			t.leaves.push_back(s);
-			consume(symbols, "Missing a '+'!");
-			t.subtrees.push_back(parse_mul(symbols));
-			t.subtrees.push_back(parse_sum_rest(symbols));
-			break;
-		default:
-			throw std::runtime_error(error_msg(s, " end of expression or '+'"));
+// sums and products are left associative, lhs is everything parsed so far
+ast_expr_t *parser_t::parse_sum_rest(ast_expr_t *lhs, int depth) {
+	while (true) {
+		auto& s = peek("Missing end of expression or '+'!");
+		switch (s.term) {
+			case Term::TOPOLOGY:
+			case Term::RPAREN:
+			case Term::END:
+			case Term::PG:
+				return lhs;
+			case Term::PLUS: {
+				consume("Missing a '+'!");
+				auto rhs = parse_mul(depth);
+				lhs = arena.make<ast_expr_bin_t>(ast_expr_bin_t::Oper::SUM, lhs, rhs);
+				break;
+			}
+			default:
+				throw std::runtime_error(error_msg(s, " end of expression or '+'"));
+		}
 	}
-
-	return t;
 }
 
-static dertree_t parse_mul(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::MUL;
-	auto& s = peek(symbols, "Missing identifier or expression!");
+ast_expr_t *parser_t::parse_mul(int depth) {
+	auto& s = peek("Missing identifier or expression!");
 	switch (s.term) {
 		case Term::IDENTIFIER:
 		case Term::LPAREN:
-			t.subtrees.push_back(parse_elem(symbols));
-			t.subtrees.push_back(parse_mul_rest(symbols));
-			break;
+			return parse_mul_rest(parse_elem(depth), depth);
 		default:
 			throw std::runtime_error(error_msg(s, "an identifier or '('"));
 	}
-	return t;
 }
 
-static dertree_t parse_mul_rest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::MULREST;
-	auto& s = peek(symbols, "Missing end of expression!");
-	switch (s.term) {
-		case Term::TOPOLOGY:
-		case Term::RPAREN:
-		case Term::END:
-		case Term::PLUS:
-		case Term::PG:
-			break;
-		case Term::MULT:
-			t.leaves.push_back(s);
-			consume(symbols, "Missing a '*'");
-			t.subtrees.push_back(parse_elem(symbols));
-			t.subtrees.push_back(parse_mul_rest(symbols));
-			break;
-		default:
-			throw std::runtime_error(error_msg(s, " end of expression or '*'"));
+ast_expr_t *parser_t::parse_mul_rest(ast_expr_t *lhs, int depth) {
+	while (true) {
+		auto& s = peek("Missing end of expression!");
+		switch (s.term) {
+			case Term::TOPOLOGY:
+			case Term::RPAREN:
+			case Term::END:
+			case Term::PLUS:
+			case Term::PG:
+				return lhs;
+			case Term::MULT: {
+				consume("Missing a '*'");
+				auto rhs = parse_elem(depth);
+				lhs = arena.make<ast_expr_bin_t>(ast_expr_bin_t::Oper::MUL, lhs, rhs);
+				break;
+			}
+			default:
+				throw std::runtime_error(error_msg(s, " end of expression or '*'"));
+		}
 	}
-	return t;
 }
 
-static dertree_t parse_elem(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::ELEM;
-	auto& s = consume(symbols, "Missing an identifier or a nested expression!");
+ast_expr_t *parser_t::parse_elem(int depth) {
+	auto& s = consume("Missing an identifier or a nested expression!");
 	switch (s.term) {
 		case Term::IDENTIFIER:
-			t.leaves.push_back(s);
-			break;
-		case Term::LPAREN:
-			t.leaves.push_back(s);
-			t.subtrees.push_back(parse_sum(symbols));
-			add_leaf(t, symbols, Term::RPAREN, "')'");
-			break;
+			return arena.make<ast_tag_t>(s.name);
+		case Term::LPAREN: {
+			if (depth >= max_expr_depth) {
+				std::ostringstream oss;
+				oss << "Expression is nested too deeply! Location: "
+					<< s.line << ", " << s.column;
+				throw std::runtime_error(oss.str());
+			}
+			auto expr = parse_sum(depth + 1);
+			expect(Term::RPAREN, "')'");
+			return expr;
+		}
 		default:
 			throw std::runtime_error(error_msg(s, "an identifier or a nested expression"));
 	}
-	return t;
 }
 
-static dertree_t parse_pg(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::PG;
-
-	add_leaf(t, symbols, Term::PG, "'pg'");
-	add_leaf(t, symbols, Term::IDENTIFIER, "an identifier");
-	add_leaf(t, symbols, Term::LBRACE, "'{'");
-	t.subtrees.push_back(parse_pg_rest(symbols));
-	add_leaf(t, symbols, Term::RBRACE, "'}'");
+ast_pg_t *parser_t::parse_pg() {
+	expect(Term::PG, "'pg'");
+	auto& name = expect(Term::IDENTIFIER, "an identifier");
+	expect(Term::LBRACE, "'{'");
+	auto pg = parse_pg_rest();
+	expect(Term::RBRACE, "'}'");
 
-	return t;
+	pg->set_name(name.name);
+	return pg;
 }
 
-static dertree_t parse_pg_rest(std::vector<symbol_t>& symbols) {
-	dertree_t t;
-	t.label = Nont::PG_REST;
-
-	add_leaf(t, symbols, Term::PG_FILE, "keyword 'file'");
-	add_leaf(t, symbols, Term::COLON, "':'");
-	add_leaf(t, symbols, Term::STRING, "a string containig \"filename\" or [\"stdin\"|\"stdout\"|\"stderr\"]");
-	add_leaf(t, symbols, Term::IDENTIFIER, "'tag'");
-	if (t.leaves.back().name != "tag") {
-		throw std::runtime_error(error_msg(t.leaves.back(), "'tag'"));
+ast_pg_t *parser_t::parse_pg_rest() {
+	expect(Term::PG_FILE, "keyword 'file'");
+	expect(Term::COLON, "':'");
+	auto& file = expect(Term::STRING, "a string containig \"filename\" or [\"stdin\"|\"stdout\"|\"stderr\"]");
+	auto& keyword = expect(Term::IDENTIFIER, "'tag'");
+	if (keyword.name != "tag") {
+		throw std::runtime_error(error_msg(keyword, "'tag'"));
 	}
-	add_leaf(t, symbols, Term::EQUAL, "'='");
-	add_leaf(t, symbols, Term::STRING, "a string");
+	expect(Term::EQUAL, "'='");
+	auto& tag = expect(Term::STRING, "a string");
 
-	return t;
+	return arena.make<ast_pg_t>(file.name, tag.name);
 }
 
 
@@ -351,28 +277,27 @@ static inline std::string error_msg(const symbol_t &s, const std::string expecte
 	return oss.str();
 }
 
-static inline symbol_t& peek(std::vector<symbol_t>& symbols, const std::string err) {
-	try {
-		return symbols.at(symbol_index);
-	} catch (std::out_of_range& e) {
+const symbol_t& parser_t::peek(const char *err) const {
+	if (symbol_index >= symbols.size()) {
 		throw std::runtime_error(err);
 	}
+	return symbols[symbol_index];
 }
 
-static inline symbol_t& consume(std::vector<symbol_t>& symbols, const std::string err) {
-	try {
-		symbol_index++;
-		return symbols.at(symbol_index - 1);
-	} catch (std::out_of_range& e) {
+const symbol_t& parser_t::consume(const char *err) {
+	if (symbol_index >= symbols.size()) {
 		throw std::runtime_error(err);
 	}
+	return symbols[symbol_index++];
 }
 
-static void add_leaf(dertree_t& t, std::vector<symbol_t>& symbols,
-		Term expected_symbol, const std::string& err) {
-	auto& s = consume(symbols, "Missing " + err);
+const symbol_t& parser_t::expect(const Term expected_symbol, const char *err) {
+	if (symbol_index >= symbols.size()) {
+		throw std::runtime_error(std::string("Missing ") + err);
+	}
+	auto& s = symbols[symbol_index++];
 	if (s.term != expected_symbol) {
 		throw std::runtime_error(error_msg(s, err));
 	}
-	t.leaves.push_back(s);
+	return s;
 }
@@ -2,40 +2,46 @@
 #define _POLICY_SYNAN_H_
 
 #include "lexer.h"
+#include "ast.h"
 
 #include <vector>
-
-
-enum class Nont {
-	SOURCE,
-	DECLS,
-	DECLREST,
-	DECL,
-	TOPOLOGY,
-	TOPOLOGYREST,
-	BASIC,
-	EDGE,
-	EDGEREST,
-	LINEAR,
-	LINEARREST,
-	EXPR,
-	SUM,
-	SUMREST,
-	MUL,
-	MULREST,
-	ELEM,
-	PG,
-	PG_REST
+#include <string>
+
+
+/* Recursive descent parser, the AST is built in the arena while the
+ * symbols are consumed. All parser state lives in the object, so
+ * separate parsers can run concurrently. */
+class parser_t {
+	public:
+		parser_t(const std::vector<symbol_t>& symbols, ast_arena_t& arena);
+		ast_source_t *parse_source();
+	private:
+		ast_decl_t *parse_decl();
+		void parse_declrest(ast_source_t& source);
+		ast_topology_t *parse_topology();
+		ast_topology_t *parse_topology_rest();
+		void parse_basic(ast_topology_basic_t& basic);
+		ast_edge_t parse_edge();
+		void parse_edge_rest(ast_topology_basic_t& basic);
+		void parse_linear(ast_topology_linear_t& linear);
+		void parse_linear_rest(ast_topology_linear_t& linear);
+		ast_topology_t *parse_expr();
+		ast_expr_t *parse_sum(int depth);
+		ast_expr_t *parse_sum_rest(ast_expr_t *lhs, int depth);
+		ast_expr_t *parse_mul(int depth);
+		ast_expr_t *parse_mul_rest(ast_expr_t *lhs, int depth);
+		ast_expr_t *parse_elem(int depth);
+		ast_pg_t *parse_pg();
+		ast_pg_t *parse_pg_rest();
+
+		// the error messages are only turned into strings when they are thrown
+		const symbol_t& peek(const char *err) const;
+		const symbol_t& consume(const char *err);
+		const symbol_t& expect(const Term expected_symbol, const char *err);
+
+		const std::vector<symbol_t>& symbols;
+		size_t symbol_index;
+		ast_arena_t& arena;
 };
 
-
-struct dertree_t {
-	Nont label;
-	std::vector<dertree_t> subtrees;
-	std::vector<symbol_t> leaves;
-};
-
-
-dertree_t parse_source(std::vector<symbol_t>& symbols);
-
-#endif
\ No newline at end of file
+#endif
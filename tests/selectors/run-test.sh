@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# These commands were used to run the test case
+# Make sure that the $RISCV variable is set to the RISC-V installation path
+
+
+function run-test {
+	local directory="$1"
+	local name="$2"
+
+	if [[ -z "$directory" ]]; then
+		echo "No directory specified!"
+		return 1
+	fi
+
+	if [[ -z "$name" ]]; then
+		echo "No test case name specified!"
+		return 1
+	fi
+
+	if [[ ! -d "$directory" ]]; then
+		mkdir "$directory"
+	fi
+
+	cd "$directory"
+
+	if [[ ! -d "tags" ]]; then
+		mkdir "tags"
+	fi
+
+	if [[ ! -d "no-tags" ]]; then
+		mkdir "no-tags"
+	fi
+
+	# Compile the test case
+	"$RISCV/bin/riscv64-unknown-elf-gcc" "../$name.c" -o "$name"
+
+	# Generate tag and policy files, the tagged ranges are at the end of policy.mtag
+	tag-parser "$name" "../$name.tags" "../$name.policy" 2>tags/tag-parser.txt
+
+	# Run without tag propagation
+	spike-tag pk "$name" \
+		>no-tags/out.txt 2>no-tags/execution.txt
+
+	# Run with tag propagation
+	spike-tag --tag-files=policy.mtag,tags.mtag \
+		pk "$name" \
+		>tags/out.txt 2>tags/execution.txt
+
+	cd ..
+}
+
+run-test "spike" "selectors"
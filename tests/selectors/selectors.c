@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <unistd.h>
+
+/* Tagged 'private' by the glob secret_* */
+char secret_key[8] = "k3y-k3y\n";
+char secret_salt[8] = "s4lt-s4\n";
+
+/* Tagged 'private' by the regex buf_(in|out)\d+ */
+char buf_in0[8] = "input-0\n";
+char buf_out12[8] = "output1\n";
+/* Not matched, no digits */
+char buf_tmp[8] = "scratch\n";
+
+/* Tagged 'public' by the regex msg_\w{3}, msg_long is not matched */
+char msg_abc[8] = "message\n";
+char msg_long[8] = "longer!\n";
+
+int main() {
+	write(1, msg_abc, 8);
+	write(1, buf_tmp, 8);
+	write(1, msg_long, 8);
+	write(1, buf_in0, 8);
+	write(1, secret_key, 8);
+	return 0;
+}